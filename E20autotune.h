@@ -0,0 +1,384 @@
+/*
+E20 cache autotuning library
+Searches one and two level cache geometries under a budget of cells for
+the Pareto frontier of miss rate, or average access time, against size.
+E20autotune.h
+*/
+
+#ifndef E20AUTOTUNE_H
+#define E20AUTOTUNE_H
+
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+
+#include "E20replay.h"
+
+
+using namespace std;
+
+
+//largest blocksize the tuner tries, in cells
+int const static TUNE_MAX_BLOCKSIZE = 64;
+//accesses between checks of a pass's running miss counts against the frontier
+int const static TUNE_CHECK_INTERVAL = 1024;
+
+/*
+    LRU stacks of every row of a cache geometry, blocksize and rows both
+    powers of two, kept maxAssoc deep. A cache of the geometry with assoc
+    ways hits exactly the accesses found less than assoc deep, since an
+    LRU cache always holds the assoc most recently used blocks of each row,
+    so one pass gives the hits of every associativity at once.
+*/
+class StackDistances {
+    public:
+        StackDistances(int Blocksize, int Rows, int MaxAssoc) :
+            row_mask(Rows - 1), max_assoc(MaxAssoc), stacks(Rows*MaxAssoc, 0) {
+            while ((1 << block_shift) < Blocksize) {block_shift++;}
+        }
+
+        //empty every row, for the next workload's cold start
+        void reset() {fill(stacks.begin(), stacks.end(), 0);}
+
+        //move addr's block to the top of its row, returns how deep it was, maxAssoc if not held
+        int access(uint16_t addr) {
+            //keys are block + 1, so an empty slot never matches
+            uint32_t key = (addr >> block_shift) + 1;
+            uint32_t *stack = &stacks[((addr >> block_shift) & row_mask)*max_assoc];
+            int depth = 0;
+            while (depth < max_assoc && stack[depth] != key) {depth++;}
+            for (int i = min(depth, max_assoc - 1); i > 0; --i) {stack[i] = stack[i - 1];}
+            stack[0] = key;
+            return depth;
+        }
+
+    private:
+        int block_shift = 0;
+        int row_mask;
+        int max_assoc;
+        vector<uint32_t> stacks;
+};
+
+//one configuration on the frontier, with an L2 size of 0 for a single level
+struct TunePoint {
+    int L1[3];
+    int L2[3];
+    unsigned long long cost;
+    unsigned long long L1_misses;
+    //accesses served by memory
+    unsigned long long misses;
+    double objective;
+
+    //the --cache argument for the configuration
+    string config() const {
+        string s = to_string(L1[0]) + "," + to_string(L1[1]) + "," + to_string(L1[2]);
+        if (L2[0] > 0) {s += "," + to_string(L2[0]) + "," + to_string(L2[1]) + "," + to_string(L2[2]);}
+        return s;
+    }
+};
+
+/*
+    Finds the configurations of at most budget cells, the L1 alone or an
+    L1 with a larger non-inclusive L2 behind it, that no other one beats on
+    both size and misses summed over the workloads, each run from a cold
+    cache. Blocksizes and row counts are powers of two, associativities
+    anything up to the maximum, and an L2 block is at least the L1's.
+
+    With a latency model, average access cycles take the place of the miss
+    rate: a level of S cells hits in base + per_doubling*log2(S) cycles, so
+    bigger levels are slower, and memory takes memory cycles. An access
+    pays the L1's latency, the L2's if it missed the L1, and memory's if it
+    missed both.
+
+    The work is shared wherever it can be. Each workload is run once and
+    its accesses recorded. One stack distance pass per geometry gives the
+    misses of all its associativities, and the L1 pass's distances say for
+    every L1 associativity which accesses reach the L2, so each L2 pass
+    also covers all L2 associativities. Candidates are pruned against the
+    frontier found so far: one whose compulsory misses, the distinct
+    blocks it must fetch, already cost no less than a configuration at
+    most its size is never simulated, and a pass stops as soon as the
+    misses it has counted put every one of its candidates out of reach.
+*/
+class Autotuner {
+    public:
+        //Latency is empty, or base, per_doubling, memory cycles
+        Autotuner(unsigned long long Budget, int MaxAssoc, const vector<double> &Latency) :
+            budget(Budget), max_assoc(MaxAssoc), latency(Latency) {}
+
+        //the recorded accesses of each workload
+        vector<vector<MemAccess>> workloads;
+        //configurations no other beats, in order of size
+        vector<TunePoint> frontier;
+        unsigned long long accesses = 0;
+        //configurations within the budget, those ruled out by compulsory misses before a pass,
+        //passes run and cut short, and the accesses they replayed
+        unsigned long long candidates = 0;
+        unsigned long long bounded = 0;
+        unsigned long long passes = 0;
+        unsigned long long cut_short = 0;
+        unsigned long long replayed = 0;
+
+        void search() {
+            accesses = 0;
+            for (const vector<MemAccess> &trace : workloads) {accesses += trace.size();}
+            vector<pair<int, int>> geometries;
+            for (int blocksize = 1; blocksize <= TUNE_MAX_BLOCKSIZE && (unsigned long long)blocksize <= budget; blocksize *= 2) {
+                compulsory.push_back(distinctBlocks(blocksize));
+                for (int rows = 1; (unsigned long long)rows*blocksize <= budget; rows *= 2) {
+                    geometries.push_back(make_pair(blocksize, rows));
+                }
+            }
+            //single levels first, as they are cheap and bound the hierarchies
+            for (const pair<int, int> &g : geometries) {searchL1(g.first, g.second);}
+            for (const pair<int, int> &g : geometries) {searchL2(g.first, g.second);}
+        }
+
+        //print what the search did and the frontier
+        void print(ostream &out) {
+            out << "Autotune: " << workloads.size() << " workloads, " << accesses << " accesses, budget " << budget <<
+                " cells, associativity up to " << max_assoc << endl;
+            out << "Candidates " << candidates << ": " << bounded << " ruled out by compulsory misses, " << passes <<
+                " passes (" << cut_short << " cut short) replaying " << replayed << " accesses" << endl;
+            out << "Pareto frontier (cells, --cache, L1 miss rate, miss rate to memory" <<
+                (latency.empty() ? "" : ", average access cycles") << "):" << endl;
+            for (const TunePoint &p : frontier) {
+                out << "\t" << p.cost << "\t" << left << setw(24) << p.config() << right << fixed << setprecision(2) <<
+                    setw(7) << rate(p.L1_misses) << "%" << setw(8) << rate(p.misses) << "%";
+                if (!latency.empty()) {out << setw(10) << p.objective;}
+                out << endl;
+                out.unsetf(ios::floatfield);
+                out << setprecision(6);
+            }
+        }
+
+    private:
+        unsigned long long budget;
+        int max_assoc;
+        vector<double> latency;
+        //distinct blocks over the workloads, by log2 of the blocksize
+        vector<unsigned long long> compulsory;
+
+        double rate(unsigned long long misses) {return accesses ? 100.0*misses/accesses : 0.0;}
+
+        double hitCycles(unsigned long long cells) {return latency[0] + latency[1]*log2((double)cells);}
+
+        //miss rate or average access cycles; L2cells is 0 for a single level
+        double objective(unsigned long long L1cells, unsigned long long L2cells, unsigned long long L1_misses,
+                unsigned long long misses) {
+            double n = accesses ? (double)accesses : 1.0;
+            if (latency.empty()) {
+                return misses/n;
+            }
+            double cycles = hitCycles(L1cells) + misses/n*latency[2];
+            if (L2cells > 0) {cycles += L1_misses/n*hitCycles(L2cells);}
+            return cycles;
+        }
+
+        //best objective on the frontier of configurations at most cost cells
+        double bar(unsigned long long cost) {
+            double best = HUGE_VAL;
+            for (const TunePoint &p : frontier) {
+                if (p.cost > cost) {break;}
+                best = p.objective;
+            }
+            return best;
+        }
+
+        //add p unless the frontier beats it, dropping the points it beats
+        void offer(const TunePoint &p) {
+            if (bar(p.cost) <= p.objective) {
+                return;
+            }
+            vector<TunePoint> kept;
+            for (const TunePoint &q : frontier) {
+                if (q.cost < p.cost || q.objective < p.objective) {kept.push_back(q);}
+            }
+            kept.insert(upper_bound(kept.begin(), kept.end(), p,
+                [](const TunePoint &a, const TunePoint &b) {return a.cost < b.cost;}), p);
+            frontier.swap(kept);
+        }
+
+        unsigned long long distinctBlocks(int blocksize) {
+            unsigned long long blocks = 0;
+            for (const vector<MemAccess> &trace : workloads) {
+                vector<bool> seen(MEM_SIZE/blocksize + 1, false);
+                for (const MemAccess &access : trace) {
+                    if (!seen[access.addr/blocksize]) {
+                        seen[access.addr/blocksize] = true;
+                        blocks++;
+                    }
+                }
+            }
+            return blocks;
+        }
+
+        unsigned long long compulsoryMisses(int blocksize) {
+            int bits = 0;
+            while ((1 << bits) < blocksize) {bits++;}
+            return compulsory[bits];
+        }
+
+        //every associativity of one L1 geometry on its own
+        void searchL1(int blocksize, int rows) {
+            unsigned long long way_cells = (unsigned long long)rows*blocksize;
+            int top = (int)min((unsigned long long)max_assoc, budget/way_cells);
+            vector<bool> live(top + 1, false);
+            int alive = 0;
+            for (int assoc = 1; assoc <= top; ++assoc) {
+                candidates++;
+                unsigned long long cells = assoc*way_cells;
+                live[assoc] = objective(cells, 0, compulsoryMisses(blocksize), compulsoryMisses(blocksize)) < bar(cells);
+                if (live[assoc]) {alive++;}
+                else {bounded++;}
+            }
+            if (alive == 0) {
+                return;
+            }
+            passes++;
+            StackDistances stacks(blocksize, rows, top);
+            //hits by depth, the deepest entry counting misses at every associativity
+            vector<unsigned long long> depths(top + 1, 0);
+            unsigned long long seen = 0;
+            for (const vector<MemAccess> &trace : workloads) {
+                stacks.reset();
+                for (const MemAccess &access : trace) {
+                    depths[stacks.access(access.addr)]++;
+                    if (++seen % TUNE_CHECK_INTERVAL != 0) {continue;}
+                    unsigned long long hits = 0;
+                    alive = 0;
+                    for (int assoc = 1; assoc <= top; ++assoc) {
+                        hits += depths[assoc - 1];
+                        unsigned long long cells = assoc*way_cells;
+                        if (live[assoc] && objective(cells, 0, seen - hits, seen - hits) >= bar(cells)) {live[assoc] = false;}
+                        if (live[assoc]) {alive++;}
+                    }
+                    if (alive == 0) {
+                        cut_short++;
+                        replayed += seen;
+                        return;
+                    }
+                }
+            }
+            replayed += seen;
+            unsigned long long hits = 0;
+            for (int assoc = 1; assoc <= top; ++assoc) {
+                hits += depths[assoc - 1];
+                if (!live[assoc]) {continue;}
+                TunePoint p = {{int(assoc*way_cells), assoc, blocksize}, {0, 0, 0}, assoc*way_cells, accesses - hits,
+                    accesses - hits, 0};
+                p.objective = objective(p.cost, 0, p.L1_misses, p.misses);
+                offer(p);
+            }
+        }
+
+        //every L2 behind every associativity of one L1 geometry
+        void searchL2(int blocksize, int rows) {
+            unsigned long long way_cells = (unsigned long long)rows*blocksize;
+            //the L2 is larger than the L1, so the L1 takes under half the budget
+            int top = (int)min((unsigned long long)max_assoc, (budget - 1)/2/way_cells);
+            if (top == 0) {
+                return;
+            }
+            //L1 depth of every access, shared by the L2 passes of all its associativities
+            passes++;
+            StackDistances stacks(blocksize, rows, top);
+            vector<vector<uint8_t>> depths;
+            vector<unsigned long long> hits_at(top + 1, 0);
+            for (const vector<MemAccess> &trace : workloads) {
+                stacks.reset();
+                depths.push_back(vector<uint8_t>(trace.size()));
+                for (size_t i = 0; i < trace.size(); ++i) {
+                    depths.back()[i] = stacks.access(trace[i].addr);
+                    hits_at[depths.back()[i]]++;
+                }
+            }
+            replayed += accesses;
+            unsigned long long L1_hits = 0;
+            for (int assoc = 1; assoc <= top; ++assoc) {
+                L1_hits += hits_at[assoc - 1];
+                unsigned long long L1cells = assoc*way_cells;
+                for (int blocksize2 = blocksize; blocksize2 <= TUNE_MAX_BLOCKSIZE &&
+                        L1cells + blocksize2 <= budget; blocksize2 *= 2) {
+                    for (int rows2 = 1; L1cells + (unsigned long long)rows2*blocksize2 <= budget; rows2 *= 2) {
+                        searchL2Geometry(depths, assoc, blocksize, L1cells, accesses - L1_hits, blocksize2, rows2);
+                    }
+                }
+            }
+        }
+
+        //every associativity of one L2 geometry behind one L1
+        void searchL2Geometry(const vector<vector<uint8_t>> &L1depths, int L1assoc, int L1blocksize,
+                unsigned long long L1cells, unsigned long long L1_misses, int blocksize, int rows) {
+            unsigned long long way_cells = (unsigned long long)rows*blocksize;
+            int bottom = (int)(L1cells/way_cells + 1);
+            int top = (int)min((unsigned long long)max_assoc, (budget - L1cells)/way_cells);
+            if (bottom > top) {
+                return;
+            }
+            vector<bool> live(top + 1, false);
+            int alive = 0;
+            for (int assoc = bottom; assoc <= top; ++assoc) {
+                candidates++;
+                unsigned long long cells = assoc*way_cells;
+                live[assoc] = objective(L1cells, cells, L1_misses, compulsoryMisses(blocksize)) < bar(L1cells + cells);
+                if (live[assoc]) {alive++;}
+                else {bounded++;}
+            }
+            if (alive == 0) {
+                return;
+            }
+            passes++;
+            StackDistances stacks(blocksize, rows, top);
+            //L2 depths of the accesses that missed the L1, whose misses here go to memory
+            vector<unsigned long long> depths(top + 1, 0);
+            unsigned long long seen = 0, reached = 0;
+            for (size_t w = 0; w < workloads.size(); ++w) {
+                const vector<MemAccess> &trace = workloads[w];
+                stacks.reset();
+                for (size_t i = 0; i < trace.size(); ++i) {
+                    //loads only reach the L2 on an L1 miss, stores write through to it
+                    bool L1_miss = L1depths[w][i] >= L1assoc;
+                    if (!L1_miss && !trace[i].store) {continue;}
+                    int depth = stacks.access(trace[i].addr);
+                    seen++;
+                    if (L1_miss) {
+                        depths[depth]++;
+                        reached++;
+                    }
+                    if (seen % TUNE_CHECK_INTERVAL != 0) {continue;}
+                    unsigned long long hits = 0;
+                    alive = 0;
+                    for (int assoc = 1; assoc <= top; ++assoc) {
+                        hits += depths[assoc - 1];
+                        unsigned long long cells = assoc*way_cells;
+                        if (live[assoc] && objective(L1cells, cells, L1_misses, reached - hits) >= bar(L1cells + cells)) {
+                            live[assoc] = false;
+                        }
+                        if (live[assoc]) {alive++;}
+                    }
+                    if (alive == 0) {
+                        cut_short++;
+                        replayed += seen;
+                        return;
+                    }
+                }
+            }
+            replayed += seen;
+            unsigned long long hits = 0;
+            for (int assoc = 1; assoc <= top; ++assoc) {
+                hits += depths[assoc - 1];
+                if (!live[assoc]) {continue;}
+                unsigned long long cells = assoc*way_cells;
+                TunePoint p = {{int(L1cells), L1assoc, L1blocksize}, {int(cells), assoc, blocksize}, L1cells + cells, L1_misses, reached - hits, 0};
+                p.objective = objective(L1cells, cells, L1_misses, p.misses);
+                offer(p);
+            }
+        }
+};
+
+#endif
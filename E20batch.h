@@ -0,0 +1,532 @@
+/*
+E20 batch library
+Runs one E20 program over many memory images at once, with the machine
+states laid out lane by lane so each instruction is decoded once for a
+block of lanes and executed eight lanes at a time, in AVX2 registers
+when the compiler targets them.
+E20batch.h
+*/
+
+#ifndef E20BATCH_H
+#define E20BATCH_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <climits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "E20machine.h"
+
+
+using namespace std;
+
+
+//lanes in one vector
+size_t const static BATCH_WIDTH = 8;
+//lanes decoded together, in vectors of BATCH_WIDTH
+size_t const static BATCH_BLOCK = 32;
+//lanes at one pc below which they step one lane at a time
+int const static BATCH_MIN_GROUP = 3;
+//lanes a batch may have, so gather indexes stay within 31 bits
+size_t const static MAX_BATCH_LANES = 1 << 17;
+
+/*
+    Eight 32-bit lanes and the handful of operations the E20 instructions
+    need, as AVX2 intrinsics or as plain loops on other targets. Masks are
+    lanes of all ones or all zeros.
+*/
+#ifdef __AVX2__
+typedef __m256i lanes8;
+
+inline lanes8 lanes_load(const unsigned *p) {return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));}
+inline lanes8 lanes_set(unsigned x) {return _mm256_set1_epi32(x);}
+inline lanes8 lanes_add(lanes8 a, lanes8 b) {return _mm256_add_epi32(a, b);}
+inline lanes8 lanes_sub(lanes8 a, lanes8 b) {return _mm256_sub_epi32(a, b);}
+inline lanes8 lanes_or(lanes8 a, lanes8 b) {return _mm256_or_si256(a, b);}
+inline lanes8 lanes_and(lanes8 a, lanes8 b) {return _mm256_and_si256(a, b);}
+inline lanes8 lanes_andnot(lanes8 mask, lanes8 a) {return _mm256_andnot_si256(mask, a);}
+inline lanes8 lanes_mul(lanes8 a, lanes8 b) {return _mm256_mullo_epi32(a, b);}
+inline lanes8 lanes_eq(lanes8 a, lanes8 b) {return _mm256_cmpeq_epi32(a, b);}
+inline lanes8 lanes_offsets() {return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);}
+
+//unsigned a < b, by flipping the sign bits for the signed compare
+inline lanes8 lanes_ltu(lanes8 a, lanes8 b) {
+    lanes8 sign = _mm256_set1_epi32(0x80000000);
+    return _mm256_cmpgt_epi32(_mm256_xor_si256(b, sign), _mm256_xor_si256(a, sign));
+}
+
+//a where mask is set, b elsewhere
+inline lanes8 lanes_select(lanes8 mask, lanes8 a, lanes8 b) {return _mm256_blendv_epi8(b, a, mask);}
+
+//write the lanes of v where mask is set
+inline void lanes_store(unsigned *p, lanes8 mask, lanes8 v) {_mm256_maskstore_epi32(reinterpret_cast<int*>(p), mask, v);}
+
+//base[index] for each lane where mask is set, 0 elsewhere
+inline lanes8 lanes_gather(const unsigned *base, lanes8 index, lanes8 mask) {
+    return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(base), index, mask, 4);
+}
+
+inline lanes8 lanes_from_bits(unsigned bits) {
+    lanes8 bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), bit), bit);
+}
+
+inline unsigned lanes_bits(lanes8 mask) {return _mm256_movemask_ps(_mm256_castsi256_ps(mask));}
+
+inline void lanes_save(unsigned out[], lanes8 v) {_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);}
+#else
+struct lanes8 {
+    unsigned v[BATCH_WIDTH];
+};
+
+//apply f to each lane of a and b
+template <typename F>
+inline lanes8 lanes_map(lanes8 a, lanes8 b, F f) {
+    lanes8 out;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {out.v[i] = f(a.v[i], b.v[i]);}
+    return out;
+}
+
+inline lanes8 lanes_load(const unsigned *p) {lanes8 out; memcpy(out.v, p, sizeof(out.v)); return out;}
+inline lanes8 lanes_set(unsigned x) {lanes8 out; fill(out.v, out.v + BATCH_WIDTH, x); return out;}
+inline lanes8 lanes_add(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x + y;});}
+inline lanes8 lanes_sub(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x - y;});}
+inline lanes8 lanes_or(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x | y;});}
+inline lanes8 lanes_and(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x & y;});}
+inline lanes8 lanes_andnot(lanes8 mask, lanes8 a) {return lanes_map(mask, a, [](unsigned x, unsigned y) {return ~x & y;});}
+inline lanes8 lanes_mul(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x*y;});}
+inline lanes8 lanes_eq(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x == y ? ~0u : 0u;});}
+
+inline lanes8 lanes_offsets() {
+    lanes8 out;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {out.v[i] = i;}
+    return out;
+}
+
+inline lanes8 lanes_ltu(lanes8 a, lanes8 b) {return lanes_map(a, b, [](unsigned x, unsigned y) {return x < y ? ~0u : 0u;});}
+
+inline lanes8 lanes_select(lanes8 mask, lanes8 a, lanes8 b) {
+    lanes8 out;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {out.v[i] = mask.v[i] ? a.v[i] : b.v[i];}
+    return out;
+}
+
+inline void lanes_store(unsigned *p, lanes8 mask, lanes8 v) {
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {
+        if (mask.v[i]) {p[i] = v.v[i];}
+    }
+}
+
+inline lanes8 lanes_gather(const unsigned *base, lanes8 index, lanes8 mask) {
+    lanes8 out;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {out.v[i] = mask.v[i] ? base[index.v[i]] : 0;}
+    return out;
+}
+
+inline lanes8 lanes_from_bits(unsigned bits) {
+    lanes8 out;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {out.v[i] = (bits >> i) & 1 ? ~0u : 0u;}
+    return out;
+}
+
+inline unsigned lanes_bits(lanes8 mask) {
+    unsigned bits = 0;
+    for (size_t i = 0; i < BATCH_WIDTH; ++i) {bits |= (mask.v[i] & 1) << i;}
+    return bits;
+}
+
+inline void lanes_save(unsigned out[], lanes8 v) {memcpy(out, v.v, sizeof(v.v));}
+#endif
+
+/*
+    Many E20 machines running the same program, each over its own memory
+    image. State is stored structure of arrays: register r of lane l is
+    regs[r*width + l] and memory word a of lane l is memory[a*width + l], so
+    the same register or word of eight neighbouring lanes is one vector.
+
+    Lanes are run in blocks of BATCH_BLOCK, each block for up to BATCH_QUANTUM
+    rounds before the next one's turn, so its state stays in the host's
+    caches. Each round, a block runs the lanes at its lowest pc that hold
+    the same instruction there, decoded once and executed together with
+    the other lanes masked off, while the lanes further ahead wait. Lanes
+    that went different ways at a branch so come back together where the
+    paths meet. Groups smaller than BATCH_MIN_GROUP step one lane at a time.
+    A block whose lanes stay apart, because a lane is stuck in a loop the
+    others have left or the lanes run different code, stops waiting after
+    BATCH_PATIENCE rounds and steps every lane for as many rounds before
+    trying again. Each lane computes exactly what E20Machine would on its
+    image.
+*/
+class BatchMachine {
+    public:
+        BatchMachine(size_t Lanes) : lanes(Lanes), width((Lanes + BATCH_BLOCK - 1)/BATCH_BLOCK*BATCH_BLOCK),
+            memory(MEM_SIZE*width, 0), regs(NUM_REGS*width, 0), pc(width, 0), steps(width, 0), missed(width, 0),
+            block_rounds(width/BATCH_BLOCK, 0), cap_round(width/BATCH_BLOCK, ULLONG_MAX),
+            halted(width/BATCH_BLOCK, 0), capped(width/BATCH_BLOCK, 0), waits(width/BATCH_BLOCK, 0) {
+            //the padding lanes of the last block never run
+            for (size_t lane = lanes; lane < width; ++lane) {halted[lane/BATCH_BLOCK] |= 1u << lane%BATCH_BLOCK;}
+        }
+
+        size_t lanes;
+        size_t width;
+        //rounds run over all blocks, and instructions executed in groups and one lane at a time
+        unsigned long long rounds = 0;
+        unsigned long long vector_steps = 0;
+        unsigned long long scalar_steps = 0;
+
+        //copy a memory image of MEM_SIZE words into a lane
+        void load(size_t lane, const unsigned image[]) {
+            for (size_t addr = 0; addr < MEM_SIZE; ++addr) {memory[addr*width + lane] = image[addr];}
+        }
+
+        unsigned lanePc(size_t lane) {return pc[lane];}
+        unsigned laneReg(size_t lane, size_t reg) {return regs[reg*width + lane];}
+        unsigned laneWord(size_t lane, size_t addr) {return memory[addr*width + lane];}
+        bool laneHalted(size_t lane) {return (halted[lane/BATCH_BLOCK] >> lane%BATCH_BLOCK) & 1;}
+
+        //instructions a lane has executed, counting the halting one
+        unsigned long long laneSteps(size_t lane) {
+            size_t block = lane/BATCH_BLOCK;
+            bool done = ((halted[block] | capped[block]) >> lane%BATCH_BLOCK) & 1;
+            return done ? steps[lane] : block_rounds[block] - missed[lane];
+        }
+
+        /*
+            Run until every lane has halted or executed max_steps instructions,
+            or about max_rounds rounds have run over all blocks.
+
+            @param max_steps The most instructions any lane executes, over all calls
+            @param max_rounds Rounds after which this call returns, finishing the current block's turn
+            @return Whether every lane has halted or reached max_steps
+        */
+        bool run(unsigned long long max_steps = ULLONG_MAX, unsigned long long max_rounds = ULLONG_MAX) {
+            size_t blocks = width/BATCH_BLOCK;
+            limit = max_steps;
+            for (size_t block = 0; block < blocks; ++block) {
+                //a larger limit lets lanes stopped by an earlier one run on
+                for (uint32_t bits = capped[block]; bits != 0; bits &= bits - 1) {
+                    size_t lane = block*BATCH_BLOCK + __builtin_ctz(bits);
+                    if (steps[lane] < limit) {
+                        missed[lane] = block_rounds[block] - steps[lane];
+                        capped[block] &= ~(1u << lane%BATCH_BLOCK);
+                    }
+                }
+                capLanes(block);
+            }
+            unsigned long long start = rounds;
+            size_t finished = 0;
+            while (finished < blocks && rounds - start < max_rounds) {
+                size_t block = next_block;
+                next_block = (next_block + 1) % blocks;
+                if ((halted[block] | capped[block]) == ALL_LANES) {
+                    finished++;
+                    continue;
+                }
+                finished = 0;
+                for (unsigned round = 0; round < BATCH_QUANTUM && (halted[block] | capped[block]) != ALL_LANES; ++round) {
+                    stepBlock(block);
+                    if (++block_rounds[block] >= cap_round[block]) {capLanes(block);}
+                    rounds++;
+                }
+            }
+            return finished == blocks;
+        }
+
+    private:
+        static const uint32_t ALL_LANES = ~uint32_t(0);
+        static const unsigned BATCH_PATIENCE = 256;
+        static const unsigned BATCH_QUANTUM = 4096;
+
+        vector<unsigned> memory;
+        vector<unsigned> regs;
+        vector<unsigned> pc;
+        //a lane's instructions are its block's rounds less the rounds it waited,
+        //fixed in steps once it halts or reaches the limit
+        vector<unsigned long long> steps;
+        vector<unsigned long long> missed;
+        vector<unsigned long long> block_rounds;
+        //block round at which the next lane of the block reaches the limit, at the
+        //earliest: lanes that wait push it back, and the next check moves it
+        vector<unsigned long long> cap_round;
+        unsigned long long limit = ULLONG_MAX;
+        size_t next_block = 0;
+        //one bit per lane of each block: lanes that halted, and lanes at the step limit
+        vector<uint32_t> halted;
+        vector<uint32_t> capped;
+        //rounds a block's leading lanes have waited, then rounds it has stepped every lane
+        vector<unsigned> waits;
+
+        //stop the lanes of a block that reached the limit, and find when the next one will
+        void capLanes(size_t block) {
+            cap_round[block] = ULLONG_MAX;
+            if (limit == ULLONG_MAX) {
+                return;
+            }
+            for (uint32_t bits = ~(halted[block] | capped[block]); bits != 0; bits &= bits - 1) {
+                size_t lane = block*BATCH_BLOCK + __builtin_ctz(bits);
+                if (block_rounds[block] - missed[lane] >= limit) {
+                    steps[lane] = limit;
+                    capped[block] |= 1u << lane%BATCH_BLOCK;
+                }
+                else {
+                    cap_round[block] = min(cap_round[block], missed[lane] + limit);
+                }
+            }
+        }
+
+        //the lanes among running at the pc of lane leader that hold the same instruction there
+        uint32_t groupAt(size_t block, uint32_t running, int leader) {
+            size_t base = block*BATCH_BLOCK;
+            unsigned lead_pc = pc[base + leader];
+            uint16_t instruction = memory[lead_pc*width + base + leader];
+            //lanes at the leader's pc fetch their words from the same row of memory
+            uint32_t group = 0;
+            for (size_t at = 0; at < BATCH_BLOCK; at += BATCH_WIDTH) {
+                lanes8 same = lanes_and(lanes_eq(lanes_load(&pc[base + at]), lanes_set(lead_pc)),
+                    lanes_eq(lanes_and(lanes_load(&memory[lead_pc*width + base + at]), lanes_set(0xFFFF)), lanes_set(instruction)));
+                group |= lanes_bits(same) << at;
+            }
+            return group & running;
+        }
+
+        //execute one instruction for the lanes of a block in group, together if there are enough of them
+        void stepGroup(size_t block, uint32_t group) {
+            size_t base = block*BATCH_BLOCK;
+            int count = __builtin_popcount(group);
+            if (count >= BATCH_MIN_GROUP) {
+                int leader = __builtin_ctz(group);
+                unsigned lead_pc = pc[base + leader];
+                executeGroup(block, group, lead_pc, memory[lead_pc*width + base + leader]);
+                vector_steps += count;
+            }
+            else {
+                for (uint32_t bits = group; bits != 0; bits &= bits - 1) {stepLane(base + __builtin_ctz(bits));}
+                scalar_steps += count;
+            }
+        }
+
+        //one round for the running lanes of a block
+        void stepBlock(size_t block) {
+            size_t base = block*BATCH_BLOCK;
+            uint32_t running = ~(halted[block] | capped[block]);
+            uint32_t group = groupAt(block, running, __builtin_ctz(running));
+            if (group == running) {
+                waits[block] = 0;
+                stepGroup(block, group);
+                return;
+            }
+            if (waits[block] >= BATCH_PATIENCE) {
+                //the lanes did not come together, so every lane steps for a while
+                for (uint32_t rest = running; rest != 0;) {
+                    group = groupAt(block, rest, __builtin_ctz(rest));
+                    stepGroup(block, group);
+                    rest &= ~group;
+                }
+                if (++waits[block] == 2*BATCH_PATIENCE) {waits[block] = 0;}
+                return;
+            }
+            int lowest = __builtin_ctz(running);
+            for (uint32_t bits = running & (running - 1); bits != 0; bits &= bits - 1) {
+                int lane = __builtin_ctz(bits);
+                if (pc[base + lane] < pc[base + lowest]) {lowest = lane;}
+            }
+            group = groupAt(block, running, lowest);
+            waits[block]++;
+            for (uint32_t bits = running & ~group; bits != 0; bits &= bits - 1) {missed[base + __builtin_ctz(bits)]++;}
+            stepGroup(block, group);
+        }
+
+        //mark lanes of a block halted by this round's instruction
+        void halt(size_t block, uint32_t bits) {
+            halted[block] |= bits;
+            for (; bits != 0; bits &= bits - 1) {
+                size_t lane = block*BATCH_BLOCK + __builtin_ctz(bits);
+                steps[lane] = block_rounds[block] + 1 - missed[lane];
+            }
+        }
+
+        //execute the instruction at lead_pc for the lanes of a block in group
+        void executeGroup(size_t block, uint32_t group, unsigned lead_pc, uint16_t instruction) {
+            uint16_t op = instruction >> 13;
+            uint16_t regA = (instruction >> 10) & 7;
+            uint16_t regB = (instruction >> 7) & 7;
+            uint16_t regDst = (instruction >> 4) & 7;
+            uint16_t func = instruction & 0b1111;
+            uint16_t imm = instruction & 0b1111111111111;
+            uint16_t ext_imm = sign_extend_imm7(instruction & 0b1111111);
+            unsigned next_pc = (lead_pc + 1) & 0b1111111111111;
+            unsigned target = (lead_pc + ext_imm + 0b1) % 128;
+            if (op == 0 && func > 4 && func != 8) {
+                //undefined functions do nothing, not even advance the pc
+                return;
+            }
+            //the instruction's effect on one vector of lanes, at lane base, of which mask are in the group
+            auto execute = [&](size_t base, unsigned bits, lanes8 mask) -> unsigned {
+                unsigned *lane_pc = &pc[base];
+                lanes8 a = lanes_load(&regs[regA*width + base]);
+                lanes8 b = lanes_load(&regs[regB*width + base]);
+                //register 0 stays 0, so writes to it are dropped
+                auto write = [&](uint16_t reg, lanes8 val) {
+                    if (reg != 0) {lanes_store(&regs[reg*width + base], mask, val);}
+                };
+                lanes8 addr = lanes_and(lanes_add(a, lanes_set(ext_imm)), lanes_set(0b1111111111111));
+                switch (op) {
+                    case 0:
+                        if (func == 8) {
+                            //jr halts lanes jumping to themselves
+                            lanes8 stopping = lanes_and(lanes_eq(a, lanes_set(lead_pc)), mask);
+                            lanes_store(lane_pc, lanes_andnot(stopping, mask), lanes_and(a, lanes_set(0b1111111111111)));
+                            return lanes_bits(stopping);
+                        }
+                        switch (func) {
+                            case 0: write(regDst, lanes_add(a, b)); break;
+                            case 1: write(regDst, lanes_sub(a, b)); break;
+                            case 2: write(regDst, lanes_or(a, b)); break;
+                            case 3: write(regDst, lanes_and(a, b)); break;
+                            default: write(regDst, lanes_and(lanes_ltu(a, b), lanes_set(1))); break;
+                        }
+                        break;
+                    case 1:
+                        write(regB, lanes_and(lanes_add(a, lanes_set(ext_imm)), lanes_set(0xFFFF)));
+                        break;
+                    case 2:
+                    case 3:
+                        if (op == 3) {write(7, lanes_set(lead_pc + 1));}
+                        if (imm == lead_pc) {return bits;}
+                        lanes_store(lane_pc, mask, lanes_set(imm));
+                        return 0;
+                    case 4:
+                    case 5: {
+                        unsigned addrs[BATCH_WIDTH];
+                        lanes_save(addrs, addr);
+                        unsigned first = addrs[__builtin_ctz(bits)];
+                        //lanes that agree on the address, as they do in loops over shared data, use its row as is
+                        bool uniform = (lanes_bits(lanes_eq(addr, lanes_set(first))) & bits) == bits;
+                        if (op == 4) {
+                            //lane l's word is at addr*width + base + l
+                            write(regB, uniform ? lanes_load(&memory[first*width + base]) :
+                                lanes_gather(&memory[base], lanes_add(lanes_mul(addr, lanes_set(width)), lanes_offsets()), mask));
+                        }
+                        else if (uniform) {
+                            lanes_store(&memory[first*width + base], mask, b);
+                        }
+                        else {
+                            //there is no AVX2 scatter, so these stores go out one lane at a time
+                            for (unsigned rest = bits; rest != 0; rest &= rest - 1) {
+                                int lane = __builtin_ctz(rest);
+                                memory[addrs[lane]*width + base + lane] = regs[regB*width + base + lane];
+                            }
+                        }
+                        break;
+                    }
+                    case 6: {
+                        lanes8 taken = lanes_and(lanes_eq(a, b), mask);
+                        if (target == lead_pc) {
+                            lanes_store(lane_pc, lanes_andnot(taken, mask), lanes_set(next_pc));
+                            return lanes_bits(taken);
+                        }
+                        lanes_store(lane_pc, mask, lanes_select(taken, lanes_set(target), lanes_set(next_pc)));
+                        return 0;
+                    }
+                    default:
+                        write(regB, lanes_and(lanes_ltu(a, lanes_set(ext_imm)), lanes_set(1)));
+                        break;
+                }
+                lanes_store(lane_pc, mask, lanes_set(next_pc));
+                return 0;
+            };
+            size_t block_base = block*BATCH_BLOCK;
+            uint32_t stopped = 0;
+            for (size_t at = 0; at < BATCH_BLOCK; at += BATCH_WIDTH) {
+                unsigned bits = (group >> at) & ((1 << BATCH_WIDTH) - 1);
+                if (bits != 0) {stopped |= execute(block_base + at, bits, lanes_from_bits(bits)) << at;}
+            }
+            if (stopped != 0) {halt(block, stopped);}
+        }
+
+        //one instruction for one lane, the same as execute_instruction over the lane's words
+        void stepLane(size_t lane) {
+            unsigned *mem = &memory[lane];
+            auto reg = [&](uint16_t r) -> unsigned& {return regs[r*width + lane];};
+            unsigned &lane_pc = pc[lane];
+            uint16_t instruction = mem[lane_pc*width];
+            uint16_t op = instruction >> 13;
+            uint16_t regA = (instruction >> 10) & 7;
+            uint16_t regB = (instruction >> 7) & 7;
+            uint16_t ext_imm = sign_extend_imm7(instruction & 0b1111111);
+            unsigned a = reg(regA);
+            unsigned b = reg(regB);
+            bool stop = false;
+            unsigned val = 0;
+            //register written, 0 for none since writes to it are dropped
+            uint16_t dst = 0;
+            switch (op) {
+                case 0: {
+                    uint16_t func = instruction & 0b1111;
+                    dst = (instruction >> 4) & 7;
+                    switch (func) {
+                        case 0: val = a + b; break;
+                        case 1: val = a - b; break;
+                        case 2: val = a | b; break;
+                        case 3: val = a & b; break;
+                        case 4: val = a < b ? 1 : 0; break;
+                        case 8:
+                            dst = 0;
+                            if (a == lane_pc) {stop = true;}
+                            else {lane_pc = a;}
+                            break;
+                        default:
+                            //undefined functions do nothing, not even advance the pc
+                            return;
+                    }
+                    if (func != 8) {lane_pc++;}
+                    break;
+                }
+                case 2:
+                case 3: {
+                    uint16_t imm = instruction & 0b1111111111111;
+                    if (op == 3) {
+                        dst = 7;
+                        val = lane_pc + 1;
+                    }
+                    if (imm == lane_pc) {stop = true;}
+                    else {lane_pc = imm;}
+                    break;
+                }
+                case 1:
+                    dst = regB;
+                    val = fix_bit_length(a + ext_imm);
+                    lane_pc++;
+                    break;
+                case 4:
+                    dst = regB;
+                    val = mem[fix_bit_length13(ext_imm + a)*width];
+                    lane_pc++;
+                    break;
+                case 5:
+                    mem[fix_bit_length13(ext_imm + a)*width] = b;
+                    lane_pc++;
+                    break;
+                case 6:
+                    if (a != b) {lane_pc++;}
+                    else if ((lane_pc + ext_imm + 0b1) % 128 == lane_pc) {stop = true;}
+                    else {lane_pc = (lane_pc + ext_imm + 0b1) % 128;}
+                    break;
+                default:
+                    dst = regB;
+                    val = a < ext_imm ? 1 : 0;
+                    lane_pc++;
+                    break;
+            }
+            if (dst != 0) {reg(dst) = val;}
+            lane_pc &= 0b1111111111111;
+            if (stop) {halt(lane/BATCH_BLOCK, 1u << lane%BATCH_BLOCK);}
+        }
+};
+
+#endif
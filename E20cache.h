@@ -0,0 +1,1173 @@
+/*
+E20 cache library
+The cache model of E20cachesim, attachable to an E20Machine.
+E20cache.h
+*/
+
+#ifndef E20CACHE_H
+#define E20CACHE_H
+
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "E20machine.h"
+#include "E20dram.h"
+#include "E20compress.h"
+
+
+using namespace std;
+
+
+/*
+    Prints out the correctly-formatted configuration of a cache.
+
+    @param cache_name The name of the cache. "L1" or "L2"
+
+    @param size The total size of the cache, measured in memory cells.
+        Excludes metadata
+
+    @param assoc The associativity of the cache. One of [1,2,4,8,16]
+
+    @param blocksize The blocksize of the cache. One of [1,2,4,8,16,32,64])
+
+    @param num_rows The number of rows in the given cache.
+
+    @param out Where to print, cout unless a caller captures the output
+*/
+inline void print_cache_config(const string &cache_name, int size, int assoc, int blocksize, int num_rows, ostream &out = cout) {
+    out << "Cache " << cache_name << " has size " << size <<
+        ", associativity " << assoc << ", blocksize " << blocksize <<
+        ", rows " << num_rows << endl;
+}
+
+/*
+    Prints out a correctly-formatted log entry.
+
+    @param cache_name The name of the cache where the event
+        occurred. "L1" or "L2"
+
+    @param status The kind of cache event. "SW", "HIT", or
+        "MISS"
+
+    @param pc The program counter of the memory
+        access instruction
+
+    @param addr The memory address being accessed.
+
+    @param row The cache row or set number where the data
+        is stored.
+
+    @param out Where to print, cout unless a caller captures the output
+*/
+inline void print_log_entry(const string &cache_name, const string &status, int pc, int addr, int row, ostream &out = cout) {
+    out << left << setw(8) << cache_name + " " + status <<  right <<
+        " pc:" << setw(5) << pc <<
+        "\taddr:" << setw(5) << addr <<
+        "\trow:" << setw(4) << row << endl;
+}
+
+/*
+    Sorts the misses of one cache into the three Cs. Beside the real cache
+    it keeps an infinite cache (the set of blocks ever touched) and a fully
+    associative LRU cache with the same number of blocks. A miss on a block
+    never seen before is compulsory; a miss the fully associative cache
+    also takes is capacity; any other miss is conflict, caused by the set
+    mapping. In multi-core runs a miss on a block this cache lost to an
+    invalidation is counted as coherence instead.
+
+    It also counts accesses and misses per row, to find set-index hot spots.
+*/
+class MissClassifier {
+    public:
+        MissClassifier(int Blocks, int Rows) : blocks(Blocks), row_accesses(Rows, 0), row_misses(Rows, 0) {}
+
+        unsigned long long hits = 0;
+        unsigned long long compulsory = 0;
+        unsigned long long capacity = 0;
+        unsigned long long conflict = 0;
+        unsigned long long coherence = 0;
+
+        //record an access to blockid in row, hit is the real cache's outcome
+        void access(int blockid, int row, bool hit) {
+            row_accesses[row]++;
+            bool shadow_hit = touchShadow(blockid);
+            bool first = seen.insert(blockid).second;
+            if (hit) {
+                hits++;
+                return;
+            }
+            row_misses[row]++;
+            if (first) {compulsory++;}
+            else if (invalidated.erase(blockid)) {coherence++;}
+            else if (!shadow_hit) {capacity++;}
+            else {conflict++;}
+        }
+
+        //the block was taken away by another cache, so its next miss is a coherence miss
+        void invalidate(int blockid) {
+            invalidated.insert(blockid);
+            auto found = where.find(blockid);
+            if (found != where.end()) {
+                lru.erase(found->second);
+                where.erase(found);
+            }
+        }
+
+        //print the 3C breakdown and the per-row histogram
+        void print(const string &name, ostream &out) {
+            unsigned long long misses = compulsory + capacity + conflict + coherence;
+            out << name << " accesses " << hits + misses << ", misses " << misses <<
+                " (compulsory " << compulsory << ", capacity " << capacity <<
+                ", conflict " << conflict << ", coherence " << coherence << ")" << endl;
+            out << name << " row heatmap:" << endl;
+            for (size_t row = 0; row < row_accesses.size(); ++row) {
+                out << "\trow:" << setw(4) << row << "\taccesses:" << setw(7) << row_accesses[row] <<
+                    "\tmisses:" << setw(7) << row_misses[row] << "\t" <<
+                    string(row_accesses[row] ? (row_misses[row]*20 + row_accesses[row] - 1)/row_accesses[row] : 0, '#') << endl;
+            }
+        }
+
+    private:
+        size_t blocks;
+        vector<unsigned long long> row_accesses;
+        vector<unsigned long long> row_misses;
+        unordered_set<int> seen;
+        unordered_set<int> invalidated;
+        //fully associative shadow, most recently used at the front
+        list<int> lru;
+        unordered_map<int, list<int>::iterator> where;
+
+        //access the shadow cache, returns whether it hit
+        bool touchShadow(int blockid) {
+            auto found = where.find(blockid);
+            if (found != where.end()) {
+                lru.splice(lru.begin(), lru, found->second);
+                return true;
+            }
+            lru.push_front(blockid);
+            where[blockid] = lru.begin();
+            if (lru.size() > blocks) {
+                where.erase(lru.back());
+                lru.pop_back();
+            }
+            return false;
+        }
+};
+
+//setup node class for doubly linked list
+class Node {
+    public:
+        Node(int data) : index(data) {
+            prev = nullptr;
+            next = nullptr;
+        }
+
+        void setNext(Node* node) {next = node;}
+
+        Node* getNext() {return next;}
+
+        void setPrev(Node* node) {prev = node;}
+
+        Node* getPrev() {return prev;}
+
+        int getIndex() {return index;}
+
+    private:
+        int index;
+        Node* prev;
+        Node* next;
+
+};
+
+class Cache {
+    private:
+        class Row {
+            public:
+                Row(const int associativity, const int blocksize) : size(associativity) {
+                    //initialize the cache to hold all 0's according to associativity and blocksize
+                    for (int i=0; i < size; ++i) {
+                        vector<uint16_t> temp;
+                        for (int j=0; j < blocksize; ++j) {
+                            temp.push_back(0);
+                        }
+                    values.push_back(temp);
+                    tags.push_back(0);
+                    valid.push_back(0);
+                    }
+
+                    //Set up doubly linked list for LRU
+                    //create head and tail node and assign to row
+                    Node* head = new Node(-1);
+                    Node* tail = new Node(-1);
+                    head_node = head;
+                    tail_node = tail;
+                    Node* temp_prev = head;
+                    Node* temp;
+                    //add nodes with the index to LRU associativity
+                    for (int i=0; i < size; ++i) {
+                        temp = new Node(i);
+                        temp_prev->setNext(temp);
+                        temp->setPrev(temp_prev);
+                        temp_prev = temp;
+                        if (i == size-1) {
+                            temp->setNext(tail);
+                            tail->setPrev(temp);
+                        }
+                    }
+                }
+
+                ~Row() {
+                    Node* node = head_node;
+                    while (node != nullptr) {
+                        Node* next = node->getNext();
+                        delete node;
+                        node = next;
+                    }
+                }
+
+                //get the LRU index among the allowed ways, set that node to the end and return the index.
+                //Only the first 64 ways can be named in a mask, so a restricted row never fills the rest
+                int getLRU(uint64_t ways = ~uint64_t(0)) {
+                    Node* LRU = head_node->getNext();
+                    if (ways != ~uint64_t(0)) {
+                        while (LRU->getIndex() >= 64 || !(ways & (uint64_t(1) << LRU->getIndex()))) {LRU = LRU->getNext();}
+                    }
+
+                    //unlink LRU, joining its neighbours
+                    Node* before = LRU->getPrev();
+                    Node* after = LRU->getNext();
+                    before->setNext(after);
+                    after->setPrev(before);
+
+                    Node* prev_old = tail_node->getPrev();
+                    //put LRU at the end
+                    prev_old->setNext(LRU);
+                    LRU->setPrev(prev_old);
+
+                    tail_node->setPrev(LRU);
+                    LRU->setNext(tail_node);
+                    return LRU->getIndex();
+                }
+
+                //move the index used to the end of the LRU
+                void pushToTail(int index) {
+                    Node* push = head_node->getNext();
+                    Node* before;
+                    Node* after;
+                    Node* prev_tail;
+                    Node* temp;
+                    for (int i=0; i < size; ++i) {
+                        temp = push->getNext();
+                        //check if the current node holds the index and move it to back if it does
+                        if (push->getIndex() == index) {
+                            //connect nodes before and after the node that needs to be pushed
+                            before = push->getPrev();
+                            after = push->getNext();
+                            before->setNext(after);
+                            after->setPrev(before);
+
+                            //connect the push node to the end
+                            prev_tail = tail_node->getPrev();
+                            prev_tail->setNext(push);
+                            push->setPrev(prev_tail);
+                            push->setNext(tail_node);
+                            tail_node->setPrev(push);
+                        }
+                        push = temp;
+                    }
+                }
+
+                //move the index to the front of the LRU, so it is the next one filled
+                void pushToHead(int index) {
+                    Node* push = head_node->getNext();
+                    while (push->getIndex() != index) {push = push->getNext();}
+                    push->getPrev()->setNext(push->getNext());
+                    push->getNext()->setPrev(push->getPrev());
+                    Node* first = head_node->getNext();
+                    head_node->setNext(push);
+                    push->setPrev(head_node);
+                    push->setNext(first);
+                    first->setPrev(push);
+                }
+
+                //the least recently used valid way other than keep, -1 if there is none
+                int oldestValid(int keep) {
+                    for (Node* node = head_node->getNext(); node != tail_node; node = node->getNext()) {
+                        int index = node->getIndex();
+                        if (index != keep && valid[index] == 1) {
+                            return index;
+                        }
+                    }
+                    return -1;
+                }
+
+                //return the index of the associativity in the row that the tag is in
+                int inTags(uint64_t tag) {
+                    for (int i=0; i < size; ++i) {
+                        if (tags[i] == tag && valid[i] == 1) {
+                            return i;
+                        }
+                    }
+                    return -1;
+                }
+
+                uint16_t getVal(int assoc, int index) {
+                    return values[assoc][index];
+                }
+
+                //hold the block under tag in assoc, copying its words from block in place
+                void setRow(int assoc, uint64_t tag, const unsigned block[]) {
+                    setTag(assoc, tag);
+                    copyBlock(assoc, block);
+                }
+
+                //hold the block under tag in assoc, without data
+                void setTag(int assoc, uint64_t tag) {
+                    if (valid[assoc] == 1) {evictions++;}
+                    valid[assoc] = 1;
+                    tags[assoc] = tag;
+                }
+
+                //refresh the copy of the block held in assoc, if the row keeps copies
+                void copyBlock(int assoc, const unsigned block[]) {
+                    for (size_t i = 0; i < values[assoc].size(); ++i) {values[assoc][i] = block[i];}
+                }
+
+                void setRowVal(int assoc, int index, uint16_t val) {
+                    if (!values[assoc].empty()) {values[assoc][index] = val;}
+                }
+
+                //drop the data copies, keeping tags, valid bits and LRU order
+                void dropValues() {
+                    for (vector<uint16_t> &block : values) {vector<uint16_t>().swap(block);}
+                }
+
+                bool isValid(int assoc) {return valid[assoc] == 1;}
+
+                //invalidate every way and put the LRU order back to way 0 first
+                void clear() {
+                    for (int i=0; i < size; ++i) {
+                        invalidate(i);
+                        pushToTail(i);
+                    }
+                    evictions = 0;
+                }
+
+                uint64_t getTag(int assoc) {return tags[assoc];}
+
+                //drop the block held in the given associativity; the freed way is the next one filled
+                void invalidate(int assoc) {
+                    valid[assoc] = 0;
+                    states[assoc] = 0;
+                    touched[assoc] = 0;
+                    pushToHead(assoc);
+                }
+
+                //coherence state of the block, only used by the multi-core L1s
+                int getState(int assoc) {return states[assoc];}
+
+                void setState(int assoc, int state) {states[assoc] = state;}
+
+                //mask of the words in the block this cache has read or written since the fill,
+                //kept only by the multi-core L1s, whose blocks are at most 64 words
+                uint64_t getTouched(int assoc) {return touched[assoc];}
+
+                void touch(int assoc, int index) {touched[assoc] |= (uint64_t(1) << index);}
+
+                void clearTouched(int assoc) {touched[assoc] = 0;}
+
+                //valid blocks replaced by a fill
+                unsigned long long evictions = 0;
+            
+            private:
+                //variables for Row class
+                const int size;
+                vector<int> valid;
+                //wide enough for the addresses of external traces
+                vector<uint64_t> tags;
+                vector<int> states = vector<int>(size, 0);
+                vector<uint64_t> touched = vector<uint64_t>(size, 0);
+                vector<vector<uint16_t>> values;
+                Node* head_node;
+                Node* tail_node;
+        };
+        
+    public:
+        Cache(const int Size, const int associativity, const int BlockSize, const string Name, ostream &Out = cout) :
+        total_size(Size), blocksize(BlockSize), name(Name), assoc(associativity), out(&Out)
+        {
+            //initialize the rows for the cache
+            for (int i=0; i < (total_size/(associativity*blocksize)); ++i) {
+                rows.push_back(new Row(associativity, blocksize));
+            }
+            //power of two geometries index with shifts and masks instead of division
+            int num_rows = rows.size();
+            if (num_rows > 0 && (blocksize & (blocksize - 1)) == 0 && (num_rows & (num_rows - 1)) == 0) {
+                pow2 = true;
+                while ((1 << block_shift) < blocksize) {block_shift++;}
+                while ((1 << row_shift) < num_rows) {row_shift++;}
+            }
+            print_cache_config(name, total_size, associativity, blocksize, rows.size(), *out);
+        }
+
+        ~Cache() {
+            for (Row* row : rows) {delete row;}
+        }
+
+        //rows are owned, so a cache is passed by reference rather than copied
+        Cache(const Cache &) = delete;
+        Cache &operator=(const Cache &) = delete;
+        //variabels for Cache
+        int total_size;
+        int blocksize;
+        vector<Row*> rows;
+        string name;
+        int assoc;
+        //where config and log lines go
+        ostream* out;
+        //3C classification of misses and per-row histograms, null unless enabled
+        unique_ptr<MissClassifier> classifier;
+        //ways new blocks may be placed in, one bit per way, for way-partitioning
+        uint64_t alloc_ways = ~uint64_t(0);
+        //whether rows keep only tags, with loads served from memory
+        bool tag_only = false;
+        //whether blocksize and the row count are powers of two, and their logs if so
+        bool pow2 = false;
+        int block_shift = 0;
+        int row_shift = 0;
+        //loads and stores this level saw, and how many hit. Stores include blocks
+        //written back into it; instruction fetches are counted by CacheHierarchy
+        unsigned long long loads = 0;
+        unsigned long long load_hits = 0;
+        unsigned long long stores = 0;
+        unsigned long long store_hits = 0;
+        //tags per way of data space when blocks are stored compressed, 1 when they are not
+        int tag_factor = 1;
+        //compressed mode: bytes of data space per row, blocks filled and their bytes before
+        //and after compression, fills by encoding, and blocks evicted to make space
+        int row_bytes = 0;
+        unsigned long long compressed_fills = 0;
+        unsigned long long raw_bytes = 0;
+        unsigned long long packed_bytes = 0;
+        unsigned long long encodings[NUM_ENCODINGS] = {};
+        unsigned long long space_evictions = 0;
+
+        //empty every row so the cache can be reused for another run, logging to Out
+        void clear(ostream &Out) {
+            out = &Out;
+            for (Row* row : rows) {row->clear();}
+            loads = load_hits = stores = store_hits = 0;
+            compressed_fills = raw_bytes = packed_bytes = space_evictions = 0;
+            fill_n(encodings, NUM_ENCODINGS, 0);
+            if (classifier) {enableClassifier();}
+            print_cache_config(name, total_size, assoc, blocksize, rows.size(), *out);
+        }
+
+        //stop keeping copies of block data. Stores always write through, so memory
+        //holds every cached word and loads can read it from there
+        void keepTagsOnly() {
+            tag_only = true;
+            for (Row* row : rows) {row->dropValues();}
+        }
+
+        //the word at addr, held in assoc of row
+        uint16_t readVal(int row, int assoc, uint16_t addr, unsigned mem[]) {
+            return tag_only ? mem[addr] : rows[row]->getVal(assoc, offsetOf(addr));
+        }
+
+        /*
+            Store blocks compressed: each row keeps factor times as many tags
+            in the data space of its assoc uncompressed blocks, and evicts
+            least recently used blocks until those it holds fit. Call before
+            the first access; the rows are rebuilt empty.
+
+            @param factor Tags per way of data space, at least 2
+        */
+        void compress(int factor) {
+            row_bytes = assoc*raw_block_bytes(blocksize);
+            tag_factor = factor;
+            assoc *= factor;
+            for (Row* &row : rows) {
+                delete row;
+                row = new Row(assoc, blocksize);
+            }
+            if (tag_only) {keepTagsOnly();}
+        }
+
+        //bytes the block held in way of row takes compressed; memory is written
+        //through, so it holds the block's current cells
+        int blockBytes(int row, int way, unsigned mem[], int *encoding = nullptr) {
+            return compressed_block_bytes(mem + blockAddr(row, rows[row]->getTag(way)), blocksize, encoding);
+        }
+
+        //after a fill of, or a store to, way of row, evict the least recently used other
+        //blocks until the row's blocks fit its data space again. Does nothing uncompressed
+        void fit(int row, int way, unsigned mem[], bool filled) {
+            if (tag_factor == 1) {
+                return;
+            }
+            if (filled) {
+                int encoding;
+                compressed_fills++;
+                raw_bytes += raw_block_bytes(blocksize);
+                packed_bytes += blockBytes(row, way, mem, &encoding);
+                encodings[encoding]++;
+            }
+            int used = 0;
+            for (int i = 0; i < assoc; ++i) {
+                if (rows[row]->isValid(i)) {used += blockBytes(row, i, mem);}
+            }
+            while (used > row_bytes) {
+                int victim = rows[row]->oldestValid(way);
+                used -= blockBytes(row, victim, mem);
+                //a freed tag is reused before any block is displaced
+                rows[row]->invalidate(victim);
+                space_evictions++;
+            }
+        }
+
+        //print the compression ratio of filled blocks and the capacity the blocks held now take
+        void printCompression(ostream &out, unsigned mem[]) {
+            unsigned long long held = 0, held_bytes = 0;
+            for (size_t row = 0; row < rows.size(); ++row) {
+                for (int way = 0; way < assoc; ++way) {
+                    if (!rows[row]->isValid(way)) {continue;}
+                    held++;
+                    held_bytes += blockBytes(row, way, mem);
+                }
+            }
+            out << name << " compression: " << tag_factor << " tags per way, " << compressed_fills << " fills";
+            for (int i = 0; i < NUM_ENCODINGS; ++i) {out << (i == 0 ? " (" : ", ") << encoding_name(i) << " " << encodings[i];}
+            out << ")" << fixed << setprecision(2) << ", ratio " << (packed_bytes ? double(raw_bytes)/packed_bytes : 0.0) <<
+                ", evicted for space " << space_evictions << endl;
+            out << name << " holds " << held << " blocks (" << held*blocksize << " cells) in " << held_bytes << " of " <<
+                row_bytes*rows.size() << " bytes, effective capacity " << double(held*blocksize)/total_size << "x" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+        //start classifying misses and counting accesses per row
+        void enableClassifier() {
+            classifier.reset(new MissClassifier(total_size/blocksize, rows.size()));
+        }
+
+        //count an access and feed it to the classifier, if there is one
+        void classify(int blockid, int row, bool hit, bool store) {
+            if (store) {
+                stores++;
+                store_hits += hit;
+            }
+            else {
+                loads++;
+                load_hits += hit;
+            }
+            if (classifier) {classifier->access(blockid, row, hit);}
+        }
+
+        //valid blocks replaced by fills since the last clear
+        unsigned long long evictions() {
+            unsigned long long total = 0;
+            for (Row* row : rows) {total += row->evictions;}
+            return total;
+        }
+
+        //block id, word within the block, row and tag an address maps to.
+        //E20 addresses fit in 13 bits, but traces of other machines need all 64
+        uint64_t blockOf(uint64_t addr) {return pow2 ? addr >> block_shift : addr/blocksize;}
+
+        int offsetOf(uint64_t addr) {return pow2 ? addr & (blocksize - 1) : addr % blocksize;}
+
+        int rowOf(uint64_t addr) {return pow2 ? blockOf(addr) & ((1 << row_shift) - 1) : blockOf(addr) % rows.size();}
+
+        uint64_t tagOf(uint64_t addr) {return pow2 ? blockOf(addr) >> row_shift : blockOf(addr) / rows.size();}
+
+        //first address of the block held under tag in row
+        int blockAddr(int row, int tag) {return (tag*rows.size() + row)*blocksize;}
+
+        //way holding the block of addr, -1 if it is not here
+        int find(uint16_t addr) {return rows[rowOf(addr)]->inTags(tagOf(addr));}
+
+        //load the block of addr from memory into the LRU way of its row, returns
+        //the first address of the block that was displaced, -1 if the way was empty
+        int fill(uint16_t addr, unsigned mem[]) {
+            int blockid = blockOf(addr);
+            int row = rowOf(addr);
+            int LRU = rows[row]->getLRU(alloc_ways);
+            int victim = rows[row]->isValid(LRU) ? blockAddr(row, rows[row]->getTag(LRU)) : -1;
+            rows[row]->setRow(LRU, tagOf(addr), mem + blockid*blocksize);
+            fit(row, LRU, mem, true);
+            return victim;
+        }
+
+        //update the tags for an access to addr without logging, returns whether it hit.
+        //Rows share nothing, so accesses to different rows may run on different threads
+        bool access(uint16_t addr, unsigned mem[]) {
+            int assoc = find(addr);
+            if (assoc != -1) {
+                rows[rowOf(addr)]->pushToTail(assoc);
+                return true;
+            }
+            fill(addr, mem);
+            return false;
+        }
+
+        //update the tags of a tag-only cache for an access to an address of any
+        //width, returns whether it hit
+        bool accessTag(uint64_t addr) {
+            int row = rowOf(addr);
+            int assoc = rows[row]->inTags(tagOf(addr));
+            if (assoc != -1) {
+                rows[row]->pushToTail(assoc);
+                return true;
+            }
+            rows[row]->setTag(rows[row]->getLRU(alloc_ways), tagOf(addr));
+            return false;
+        }
+
+        //drop the block of addr, returns whether it was held
+        bool evict(uint16_t addr) {
+            int assoc = find(addr);
+            if (assoc == -1) {
+                return false;
+            }
+            rows[rowOf(addr)]->invalidate(assoc);
+            return true;
+        }
+
+        //accept a dirty block written back from the level above and log it
+        void writeBack(uint16_t addr, unsigned mem[], unsigned pc) {
+            int blockid = blockOf(addr);
+            int row = rowOf(addr);
+            int tag = tagOf(addr);
+            int assoc = rows[row]->inTags(tag);
+            classify(blockid, row, assoc != -1, true);
+            if (assoc != -1) {
+                //refresh the copy already held here
+                rows[row]->copyBlock(assoc, mem + blockid*blocksize);
+                rows[row]->pushToTail(assoc);
+            }
+            else {
+                int LRU = rows[row]->getLRU(alloc_ways);
+                rows[row]->setRow(LRU, tag, mem + blockid*blocksize);
+                fit(row, LRU, mem, true);
+            }
+            print_log_entry(name, "WB", pc, addr, row, *out);
+        }
+
+
+        //return val from cache or memory for single cache
+        uint16_t getVal(uint16_t addr, unsigned mem[], unsigned pc) {
+            //obtain relevant numbers
+            int blockid = blockOf(addr);
+            int row = rowOf(addr);
+            int tag = tagOf(addr);
+            int assoc = rows[row]->inTags(tag);
+            classify(blockid, row, assoc != -1, false);
+            
+            if (assoc != -1) {
+                //if hit then move the accessed associativity to the end of LRU
+                //and return val
+                rows[row]->pushToTail(assoc);
+                print_log_entry(name, "HIT", pc, addr, row, *out);
+                return readVal(row, assoc, addr, mem);
+            }
+            else {
+                //if miss then write block from memory into row and return val
+                int LRU = rows[row]->getLRU(alloc_ways);
+                rows[row]->setRow(LRU, tag, mem + blockid*blocksize);
+                fit(row, LRU, mem, true);
+                print_log_entry(name, "MISS", pc, addr, row, *out);
+                return readVal(row, LRU, addr, mem);
+            }
+        }
+
+        //return val from cache or memory for double cache
+        uint16_t doubleCacheGetVal(uint16_t addr, unsigned mem[], Cache &L2, unsigned pc) {
+            //obtain relevant numbers for both caches
+            int L1blockid = blockOf(addr);
+            int L1row = rowOf(addr);
+            int L1tag = tagOf(addr);
+            int assoc = rows[L1row]->inTags(L1tag);
+
+            int L2blockid = L2.blockOf(addr);
+            int L2row = L2.rowOf(addr);
+            int L2tag = L2.tagOf(addr);
+            int L2assoc = L2.rows[L2row]->inTags(L2tag);
+            //L2 only sees the access when L1 misses
+            classify(L1blockid, L1row, assoc != -1, false);
+            if (assoc == -1) {L2.classify(L2blockid, L2row, L2assoc != -1, false);}
+
+            if (assoc != -1) {
+                //if hit in L1 then push L1 associativity to end of LRU
+                //print log and return val
+                rows[L1row]->pushToTail(assoc);
+                print_log_entry(name, "HIT", pc, addr, L1row, *out);
+                return readVal(L1row, assoc, addr, mem);
+            }
+            else if (assoc == -1 && L2assoc != -1) {
+                //if miss L1 hit L2
+                //move vals from L2 into L1 and move L2 associativity to end of LRU
+                L2.rows[L2row]->pushToTail(L2assoc);
+                //write vals into L1
+                int LRU = rows[L1row]->getLRU(alloc_ways);
+                rows[L1row]->setRow(LRU, L1tag, mem + L1blockid*blocksize);
+                fit(L1row, LRU, mem, true);
+                //print log and return val
+                print_log_entry(name, "MISS", pc, addr, L1row, *out);
+                print_log_entry(L2.name, "HIT", pc, addr, L2row, *L2.out);
+                return readVal(L1row, LRU, addr, mem);
+            }
+            else if (assoc == -1 && L2assoc == -1) {
+                //if both caches miss copy data from memory into both caches
+                int L2_LRU = L2.rows[L2row]->getLRU(L2.alloc_ways);
+                L2.rows[L2row]->setRow(L2_LRU, L2tag, mem + L2blockid*L2.blocksize);
+                L2.fit(L2row, L2_LRU, mem, true);
+                int LRU = rows[L1row]->getLRU(alloc_ways);
+                rows[L1row]->setRow(LRU, L1tag, mem + L1blockid*blocksize);
+                fit(L1row, LRU, mem, true);
+                //print log and return val
+                print_log_entry(name, "MISS", pc, addr, L1row, *out);
+                print_log_entry(L2.name, "MISS", pc, addr, L2row, *L2.out);
+                return readVal(L1row, LRU, addr, mem);
+            }
+            return 0;
+        }
+
+        //takes val and writes it into the cache and memory at given address for single cache
+        void setVal(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) {
+            //obtain relevant numbers
+            int blockid = blockOf(addr);
+            int row = rowOf(addr);
+            int tag = tagOf(addr);
+            int index = offsetOf(addr);
+            int assoc = rows[row]->inTags(tag);
+            classify(blockid, row, assoc != -1, true);
+
+            int way = assoc;
+            if (assoc != -1) {
+                //if hit, then change val in cache and move associativity to the end of LRU
+                rows[row]->setRowVal(assoc, index, val);
+                rows[row]->pushToTail(assoc);
+            }
+            else {
+                //if miss, copy vals from memory into cache and write val to cache
+                way = rows[row]->getLRU(alloc_ways);
+                rows[row]->setRow(way, tag, mem + blockid*blocksize);
+                rows[row]->setRowVal(way, index, val);
+            }
+            //write to memory and print log
+            mem[addr] = val;
+            //the stored cell may change how well the block compresses
+            fit(row, way, mem, assoc == -1);
+            print_log_entry(name, "SW", pc, addr, row, *out);
+        }
+
+        //takes val and writes into cache and memory at given address for double cache
+        void doubleCacheSetVal(uint16_t addr, uint16_t val, unsigned mem[], Cache &L2, unsigned pc) {
+            //setup relevant numbers
+            int L1blockid = blockOf(addr);
+            int L1row = rowOf(addr);
+            int L1tag = tagOf(addr);
+            int L1index = offsetOf(addr);
+            int assoc = rows[L1row]->inTags(L1tag);
+
+            int L2blockid = L2.blockOf(addr);
+            int L2row = L2.rowOf(addr);
+            int L2tag = L2.tagOf(addr);
+            int L2index = L2.offsetOf(addr);
+            int L2assoc = L2.rows[L2row]->inTags(L2tag);
+            //stores write through, so both levels see them
+            classify(L1blockid, L1row, assoc != -1, true);
+            L2.classify(L2blockid, L2row, L2assoc != -1, true);
+            int L1way = assoc;
+            int L2way = L2assoc;
+
+            if (assoc != -1 && L2assoc != -1) {
+                //if both hit write to caches and push both associativities to tail
+                rows[L1row]->setRowVal(assoc, L1index, val);
+                rows[L1row]->pushToTail(assoc);
+                L2.rows[L2row]->setRowVal(L2assoc, L2index, val);
+                L2.rows[L2row]->pushToTail(L2assoc);
+            }
+            else if (assoc == -1 && L2assoc != -1) {
+                //if L1 miss and L2 hit, fill L1. Memory is written through, so it holds
+                //the block as L2 does, and at L1's own block boundaries
+                L2.rows[L2row]->pushToTail(L2assoc);
+                L1way = rows[L1row]->getLRU(alloc_ways);
+                rows[L1row]->setRow(L1way, L1tag, mem + L1blockid*blocksize);
+                //write val to both caches
+                rows[L1row]->setRowVal(L1way, L1index, val);
+                L2.rows[L2row]->setRowVal(L2assoc, L2index, val);
+            }
+            else if (assoc != -1 && L2assoc == -1) {
+                //if L1 hits and L2 misses, write to L1
+                rows[L1row]->setRowVal(assoc, L1index, val);
+                //fill L2 from memory, which already holds the L1 block
+                rows[L1row]->pushToTail(assoc);
+                L2way = L2.rows[L2row]->getLRU(L2.alloc_ways);
+                mem[addr] = val;
+                L2.rows[L2row]->setRow(L2way, L2tag, mem + L2blockid*L2.blocksize);
+            }
+            else if (assoc == -1 && L2assoc == -1) {
+                //if both miss copy vals from memory to caches
+                L2way = L2.rows[L2row]->getLRU(L2.alloc_ways);
+                L2.rows[L2row]->setRow(L2way, L2tag, mem + L2blockid*L2.blocksize);
+                L1way = rows[L1row]->getLRU(alloc_ways);
+                rows[L1row]->setRow(L1way, L1tag, mem + L1blockid*blocksize);
+                //write val to both caches
+                rows[L1row]->setRowVal(L1way, L1index, val);
+                L2.rows[L2row]->setRowVal(L2way, L2index, val);
+            }
+            //write to memory and print log
+            mem[addr] = val;
+            fit(L1row, L1way, mem, assoc == -1);
+            L2.fit(L2row, L2way, mem, L2assoc == -1);
+            print_log_entry(name, "SW", pc, addr, L1row, *out);
+            print_log_entry(L2.name, "SW", pc, addr, L2row, *L2.out);
+        }
+};
+
+//how the contents of an L1 and L2 relate
+enum InclusionPolicy {NON_INCLUSIVE, INCLUSIVE, EXCLUSIVE};
+
+inline const char* inclusion_name(InclusionPolicy policy) {
+    return policy == INCLUSIVE ? "inclusive" : policy == EXCLUSIVE ? "exclusive" : "non-inclusive";
+}
+
+/*
+    The L1 and optional L2 that an E20Machine's lw and sw go through.
+    Neither cache is owned.
+
+    With two levels the policy decides what the L2 holds:
+        non-inclusive  both levels are filled on a miss and evict on their
+                       own, so either may hold blocks the other does not
+        inclusive      as non-inclusive, but when the L2 evicts a block the
+                       L1 drops its copies too ("BINV"), so the L2 always
+                       holds everything in the L1
+        exclusive      a block lives in one level only: an L2 hit moves the
+                       block up into the L1, misses fill only the L1, and
+                       the block the L1 displaces moves down into the L2
+                       ("VICT"). Both levels must use the same blocksize
+
+    An optional DRAM model, not owned, is charged for every block fetched
+    from memory and, as the caches write through, for every store.
+
+    With set sampling only accesses to every sample_every-th L1 row go
+    through the caches; the rest read and write memory directly, with no
+    log. The misses of the sampled rows are scaled up to estimates for the
+    whole run, with a 95% confidence bound from the spread between rows.
+    The L2 estimate is only unbiased when every L2 set holds blocks of a
+    single L1 row, which the caller checks.
+*/
+class CacheHierarchy : public MemoryHierarchy {
+    public:
+        CacheHierarchy(Cache* l1, Cache* l2, InclusionPolicy Policy = NON_INCLUSIVE) : L1(l1), L2(l2), policy(Policy) {}
+
+        Cache* L1;
+        Cache* L2;
+        InclusionPolicy policy;
+        DramModel* dram = nullptr;
+
+        //accesses served by each level, memory counts L2 misses
+        unsigned long long L1_hits = 0;
+        unsigned long long L2_hits = 0;
+        unsigned long long memory_fetches = 0;
+        //L1 blocks dropped because the L2 evicted them (inclusive)
+        unsigned long long back_invalidations = 0;
+        //blocks moved from the L2 up into the L1 (exclusive)
+        unsigned long long promotions = 0;
+        //L1 victims moved down into the L2 (exclusive)
+        unsigned long long victims = 0;
+        //simulate one L1 row in this many, 1 for all of them
+        int sample_every = 1;
+        //accesses to rows left out by sampling
+        unsigned long long skipped = 0;
+        //instruction cache in front of fetch, or L1 itself when unified; null fetches from memory
+        Cache* I1 = nullptr;
+        //log every fetch as IF HIT or IF MISS at its pc
+        bool log_fetches = false;
+        //fetches served by each level, memory counts L2 misses
+        unsigned long long fetches = 0;
+        unsigned long long fetch_I1_hits = 0;
+        unsigned long long fetch_L2_hits = 0;
+        unsigned long long fetch_memory = 0;
+
+        uint16_t fetch(uint16_t pc, unsigned mem[]) override {
+            if (I1 == nullptr) {
+                return mem[pc];
+            }
+            fetches++;
+            bool hit = I1->access(pc, mem);
+            if (log_fetches) {print_log_entry(I1->name, hit ? "IF HIT" : "IF MISS", pc, pc, I1->rowOf(pc), *I1->out);}
+            if (hit) {
+                fetch_I1_hits++;
+                return mem[pc];
+            }
+            //the L2 is shared with the data side
+            bool L2_hit = L2 != nullptr && L2->access(pc, mem);
+            if (L2 != nullptr && log_fetches) {print_log_entry(L2->name, L2_hit ? "IF HIT" : "IF MISS", pc, pc, L2->rowOf(pc), *L2->out);}
+            if (L2_hit) {
+                fetch_L2_hits++;
+            }
+            else {
+                fetch_memory++;
+                if (dram != nullptr) {
+                    int blocksize = (L2 != nullptr ? L2 : I1)->blocksize;
+                    dram->access(pc/blocksize*blocksize, blocksize, false);
+                }
+            }
+            return mem[pc];
+        }
+
+        uint16_t load(uint16_t addr, unsigned mem[], unsigned pc) override {
+            if (!sampled(addr)) {
+                skipped++;
+                return mem[addr];
+            }
+            count(addr, false);
+            if (L2 == nullptr) {
+                return L1->getVal(addr, mem, pc);
+            }
+            if (policy == EXCLUSIVE) {
+                int assoc = exclusiveFetch(addr, mem, pc, true);
+                return L1->readVal(L1->rowOf(addr), assoc, addr, mem);
+            }
+            vector<int> held = L2blocks(addr);
+            uint16_t val = L1->doubleCacheGetVal(addr, mem, *L2, pc);
+            if (policy == INCLUSIVE) {backInvalidate(held, addr, pc);}
+            return val;
+        }
+
+        void store(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) override {
+            if (!sampled(addr)) {
+                skipped++;
+                mem[addr] = val;
+                return;
+            }
+            count(addr, true);
+            if (dram != nullptr) {dram->access(addr, 1, true);}
+            if (L2 == nullptr) {
+                L1->setVal(addr, val, mem, pc);
+                return;
+            }
+            if (policy == EXCLUSIVE) {
+                int assoc = exclusiveFetch(addr, mem, pc, false);
+                L1->rows[L1->rowOf(addr)]->setRowVal(assoc, addr % L1->blocksize, val);
+                mem[addr] = val;
+                print_log_entry(L1->name, "SW", pc, addr, L1->rowOf(addr), *L1->out);
+                return;
+            }
+            vector<int> held = L2blocks(addr);
+            L1->doubleCacheSetVal(addr, val, mem, *L2, pc);
+            if (policy == INCLUSIVE) {backInvalidate(held, addr, pc);}
+        }
+
+        //print where fetches were served
+        void printFetchStats(ostream &out) {
+            out << I1->name << " fetches " << fetches << ", IF hits " << fetch_I1_hits << ", IF misses " <<
+                fetches - fetch_I1_hits;
+            if (L2 != nullptr) {out << " (" << L2->name << " hits " << fetch_L2_hits << ", memory " << fetch_memory << ")";}
+            out << fixed << setprecision(2) << ", hit rate " << (fetches ? 100.0*fetch_I1_hits/fetches : 0.0) << "%" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+        //print the policy counters and how many distinct cells the two levels hold
+        void printStats(ostream &out) {
+            //co-running programs are cached at physical addresses past one machine's memory
+            vector<bool> cells(MEM_SIZE, false);
+            unsigned long long distinct = 0;
+            for (Cache* cache : {L1, L2}) {
+                for (size_t row = 0; row < cache->rows.size(); ++row) {
+                    for (int way = 0; way < cache->assoc; ++way) {
+                        if (!cache->rows[row]->isValid(way)) {continue;}
+                        int start = cache->blockAddr(row, cache->rows[row]->getTag(way));
+                        if ((size_t)(start + cache->blocksize) > cells.size()) {cells.resize(start + cache->blocksize, false);}
+                        for (int i = start; i < start + cache->blocksize; ++i) {
+                            if (!cells[i]) {
+                                cells[i] = true;
+                                distinct++;
+                            }
+                        }
+                    }
+                }
+            }
+            out << "Inclusion policy: " << inclusion_name(policy) << endl;
+            out << "Served by: " << L1->name << " " << L1_hits << ", " << L2->name << " " << L2_hits <<
+                ", memory " << memory_fetches << endl;
+            out << "Back-invalidations " << back_invalidations << ", promotions " << promotions <<
+                ", victims " << victims << endl;
+            out << "Distinct cells held: " << distinct << " of " << L1->total_size + L2->total_size << endl;
+        }
+
+        //print the sampled fraction and the estimated misses of each level over the whole run
+        void printSampleStats(ostream &out) {
+            unsigned long long simulated = L1_hits + L2_hits + memory_fetches;
+            unsigned long long total = simulated + skipped;
+            size_t sampled_rows = (L1->rows.size() + sample_every - 1) / sample_every;
+            //rows never accessed still count as sampled rows with nothing in them
+            row_accesses.resize(L1->rows.size(), 0);
+            row_L1_misses.resize(L1->rows.size(), 0);
+            row_L2_misses.resize(L1->rows.size(), 0);
+            out << "Sampled " << sampled_rows << " of " << L1->rows.size() << " " << L1->name << " rows, " <<
+                simulated << " of " << total << " accesses" << endl;
+            printEstimate(out, L1->name + " misses", row_L1_misses, total);
+            if (L2 != nullptr) {printEstimate(out, L2->name + " misses", row_L2_misses, total);}
+        }
+
+    private:
+        //accesses and misses of each sampled L1 row, for the sampling error
+        vector<unsigned long long> row_accesses;
+        vector<unsigned long long> row_L1_misses;
+        vector<unsigned long long> row_L2_misses;
+
+        bool sampled(uint16_t addr) {
+            return sample_every == 1 || L1->rowOf(addr) % sample_every == 0;
+        }
+
+        /*
+            Prints the estimate of a miss count over all rows from the sampled
+            rows, as a ratio estimator over rows (cluster sampling).
+
+            @param misses Misses of each L1 row, only sampled rows counted
+            @param total Accesses of the whole run, sampled or not
+        */
+        void printEstimate(ostream &out, const string &what, const vector<unsigned long long> &misses, unsigned long long total) {
+            double n = 0, accesses = 0, missed = 0;
+            for (size_t row = 0; row < row_accesses.size(); row += sample_every) {
+                n++;
+                accesses += row_accesses[row];
+                missed += misses[row];
+            }
+            double rate = accesses > 0 ? missed/accesses : 0;
+            double bound = 0;
+            bool known = true;
+            if (sample_every > 1) {
+                //between-row variance of the residuals, with the finite population correction
+                double spread = 0;
+                for (size_t row = 0; row < row_accesses.size(); row += sample_every) {
+                    double residual = misses[row] - rate*row_accesses[row];
+                    spread += residual*residual;
+                }
+                double mean = accesses/n;
+                known = n > 1 && mean > 0;
+                if (known) {bound = 1.96*sqrt((1 - n/L1->rows.size()) * spread/(n - 1) / n) / mean;}
+            }
+            out << fixed << setprecision(2) << what << ": estimated " << rate*total;
+            if (known) {out << " +/- " << bound*total;}
+            else {out << " +/- unknown";}
+            out << " (rate " << 100*rate << "%";
+            if (known) {out << " +/- " << 100*bound << "%";}
+            out << ", 95%)" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+        //tally which level will serve addr, before the access changes anything
+        void count(uint16_t addr, bool store) {
+            int where;
+            if (L1->find(addr) != -1) {
+                L1_hits++;
+                where = 0;
+                //a store writes through to an L2 that fills a block it does not hold from memory
+                if (store && dram != nullptr && L2 != nullptr && policy != EXCLUSIVE && L2->find(addr) == -1) {
+                    dram->access(addr/L2->blocksize*L2->blocksize, L2->blocksize, false);
+                }
+            }
+            else if (L2 != nullptr && L2->find(addr) != -1) {
+                L2_hits++;
+                where = 1;
+            }
+            else {
+                memory_fetches++;
+                where = 2;
+                if (dram != nullptr) {
+                    //the block of the last level is what comes from memory
+                    int blocksize = (L2 != nullptr ? L2 : L1)->blocksize;
+                    dram->access(addr/blocksize*blocksize, blocksize, false);
+                }
+            }
+            if (row_accesses.empty()) {
+                row_accesses.resize(L1->rows.size(), 0);
+                row_L1_misses.resize(L1->rows.size(), 0);
+                row_L2_misses.resize(L1->rows.size(), 0);
+            }
+            int row = L1->rowOf(addr);
+            row_accesses[row]++;
+            if (where > 0) {row_L1_misses[row]++;}
+            if (where > 1) {row_L2_misses[row]++;}
+        }
+
+        //first addresses of the blocks in the L2 row addr maps to
+        vector<int> L2blocks(uint16_t addr) {
+            vector<int> blocks;
+            int row = L2->rowOf(addr);
+            for (int way = 0; way < L2->assoc; ++way) {
+                if (L2->rows[row]->isValid(way)) {blocks.push_back(L2->blockAddr(row, L2->rows[row]->getTag(way)));}
+            }
+            return blocks;
+        }
+
+        //drop from the L1 every block that was in held but has since left the L2 row of addr
+        void backInvalidate(const vector<int> &held, uint16_t addr, unsigned pc) {
+            vector<int> now = L2blocks(addr);
+            for (int block : held) {
+                if (find(now.begin(), now.end(), block) != now.end()) {continue;}
+                for (int a = block; a < block + L2->blocksize; a += L1->blocksize) {
+                    if (L1->evict(a)) {
+                        back_invalidations++;
+                        print_log_entry(L1->name, "BINV", pc, a, L1->rowOf(a), *L1->out);
+                    }
+                }
+            }
+        }
+
+        /*
+            Bring the block of addr into the L1 under the exclusive policy.
+
+            @param logged Whether to log hits and misses, which only loads do
+
+            @return The L1 way now holding the block
+        */
+        int exclusiveFetch(uint16_t addr, unsigned mem[], unsigned pc, bool logged) {
+            int blockid = addr/L1->blocksize;
+            int row = L1->rowOf(addr);
+            int assoc = L1->find(addr);
+            L1->classify(blockid, row, assoc != -1, !logged);
+            if (assoc != -1) {
+                L1->rows[row]->pushToTail(assoc);
+                if (logged) {print_log_entry(L1->name, "HIT", pc, addr, row, *L1->out);}
+                return assoc;
+            }
+            bool L2hit = L2->find(addr) != -1;
+            L2->classify(blockid, L2->rowOf(addr), L2hit, !logged);
+            if (L2hit) {
+                //the block moves up, so it leaves the L2
+                L2->evict(addr);
+                promotions++;
+            }
+            int victim = L1->fill(addr, mem);
+            if (logged) {
+                print_log_entry(L1->name, "MISS", pc, addr, row, *L1->out);
+                print_log_entry(L2->name, L2hit ? "HIT" : "MISS", pc, addr, L2->rowOf(addr), *L2->out);
+            }
+            if (victim != -1) {
+                //whatever the L2 displaces for it goes back to memory, which is already current
+                L2->fill(victim, mem);
+                victims++;
+                print_log_entry(L2->name, "VICT", pc, victim, L2->rowOf(victim), *L2->out);
+            }
+            return L1->find(addr);
+        }
+};
+
+#endif
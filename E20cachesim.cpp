@@ -1,878 +1,1064 @@
-/*
-CS-UY 2214
-Adapted from Jeff Epstein
-Starter code for E20 cache Simulator
-simcache.cpp
-*/
-
-#include <cstddef>
-#include <iostream>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <iomanip>
-#include <regex>
-#include <cstdlib>
-
-
-using namespace std;
-
-
-// Some helpful constant values that we'll be using.
-size_t const static NUM_REGS = 8;
-size_t const static MEM_SIZE = 1<<13;
-size_t const static REG_SIZE = 1<<16;
-
-/*
-    Prints out the correctly-formatted configuration of a cache.
-
-    @param cache_name The name of the cache. "L1" or "L2"
-
-    @param size The total size of the cache, measured in memory cells.
-        Excludes metadata
-
-    @param assoc The associativity of the cache. One of [1,2,4,8,16]
-
-    @param blocksize The blocksize of the cache. One of [1,2,4,8,16,32,64])
-
-    @param num_rows The number of rows in the given cache.
-*/
-void print_cache_config(const string &cache_name, int size, int assoc, int blocksize, int num_rows) {
-    cout << "Cache " << cache_name << " has size " << size <<
-        ", associativity " << assoc << ", blocksize " << blocksize <<
-        ", rows " << num_rows << endl;
-}
-
-/*
-    Prints out a correctly-formatted log entry.
-
-    @param cache_name The name of the cache where the event
-        occurred. "L1" or "L2"
-
-    @param status The kind of cache event. "SW", "HIT", or
-        "MISS"
-
-    @param pc The program counter of the memory
-        access instruction
-
-    @param addr The memory address being accessed.
-
-    @param row The cache row or set number where the data
-        is stored.
-*/
-void print_log_entry(const string &cache_name, const string &status, int pc, int addr, int row) {
-    cout << left << setw(8) << cache_name + " " + status <<  right <<
-        " pc:" << setw(5) << pc <<
-        "\taddr:" << setw(5) << addr <<
-        "\trow:" << setw(4) << row << endl;
-}
-
-/*
-    Loads an E20 machine code file into the list
-    provided by mem. We assume that mem is
-    large enough to hold the values in the machine
-    code file.
-
-
-    @param f Open file to read from
-    @param mem Array represetnting memory into which to read program
-*/
-void load_machine_code(ifstream &f, unsigned mem[])
-{
-    regex machine_code_re("^ram\\[(\\d+)\\] = 16'b(\\d+);.*$");
-    size_t expectedaddr = 0;
-    string line;
-    while (getline(f, line))
-    {
-        smatch sm;
-        if (!regex_match(line, sm, machine_code_re))
-        {
-            cerr << "Can't parse line: " << line << endl;
-            exit(1);
-        }
-        size_t addr = stoi(sm[1], nullptr, 10);
-        unsigned instr = stoi(sm[2], nullptr, 2);
-        if (addr != expectedaddr)
-        {
-            cerr << "Memory addresses encountered out of sequence: " << addr << endl;
-            exit(1);
-        }
-        if (addr >= MEM_SIZE)
-        {
-            cerr << "Program too big for memory" << endl;
-            exit(1);
-        }
-        expectedaddr++;
-        mem[addr] = instr;
-    }
-}
-
-uint16_t fix_bit_length(uint16_t val) {
-    return val = val & 0b1111111111111111;
-}
-
-uint16_t fix_bit_length13(uint16_t val) {
-    return val = val & 0b1111111111111;
-}
-
-uint16_t convert_neg_imm(uint16_t val) {
-    val = (~val & 0b0000000001111111) + 0b1;
-    return val;
-}
-
-uint16_t sign_extend_imm7(uint16_t val) {
-    if (val & 0b1000000) {
-        return val |= 0b1111111111000000;
-    }
-    else {
-        return val;
-    }
-}
-
-//setup node class for doubly linked list
-class Node {
-    public:
-        Node(int data) : index(data) {
-            prev = nullptr;
-            next = nullptr;
-        }
-
-        void setNext(Node* node) {next = node;}
-
-        Node* getNext() {return next;}
-
-        void setPrev(Node* node) {prev = node;}
-
-        Node* getPrev() {return prev;}
-
-        int getIndex() {return index;}
-
-    private:
-        int index;
-        Node* prev;
-        Node* next;
-
-};
-
-class Cache {
-    private:
-        class Row {
-            public:
-                Row(const int associativity, const int blocksize) : size(associativity) {
-                    //initialize the cache to hold all 0's according to associativity and blocksize
-                    for (int i=0; i < size; ++i) {
-                        vector<uint16_t> temp;
-                        for (int j=0; j < blocksize; ++j) {
-                            temp.push_back(0);
-                        }
-                    values.push_back(temp);
-                    tags.push_back(0);
-                    valid.push_back(0);
-                    }
-
-                    //Set up doubly linked list for LRU
-                    //create head and tail node and assign to row
-                    Node* head = new Node(-1);
-                    Node* tail = new Node(-1);
-                    head_node = head;
-                    tail_node = tail;
-                    Node* temp_prev = head;
-                    Node* temp;
-                    //add nodes with the index to LRU associativity
-                    for (int i=0; i < size; ++i) {
-                        temp = new Node(i);
-                        temp_prev->setNext(temp);
-                        temp->setPrev(temp_prev);
-                        temp_prev = temp;
-                        if (i == size-1) {
-                            temp->setNext(tail);
-                            tail->setPrev(temp);
-                        }
-                    }
-                }
-
-                //get the LRU index and set that node to the end and return the index
-                int getLRU() {
-                    Node* LRU = head_node->getNext();
-                    Node* new_recent = LRU->getNext();
-                    
-                    //set node after LRU to new LRU
-                    head_node->setNext(new_recent);
-                    new_recent->setPrev(head_node);
-
-                    Node* prev_old = tail_node->getPrev();
-                    //put LRU at the end
-                    prev_old->setNext(LRU);
-                    LRU->setPrev(prev_old);
-
-                    tail_node->setPrev(LRU);
-                    LRU->setNext(tail_node);
-                    return LRU->getIndex();
-                }
-
-                //move the index used to the end of the LRU
-                void pushToTail(int index) {
-                    Node* push = head_node->getNext();
-                    Node* before;
-                    Node* after;
-                    Node* prev_tail;
-                    Node* temp;
-                    for (int i=0; i < size; ++i) {
-                        temp = push->getNext();
-                        //check if the current node holds the index and move it to back if it does
-                        if (push->getIndex() == index) {
-                            //connect nodes before and after the node that needs to be pushed
-                            before = push->getPrev();
-                            after = push->getNext();
-                            before->setNext(after);
-                            after->setPrev(before);
-
-                            //connect the push node to the end
-                            prev_tail = tail_node->getPrev();
-                            prev_tail->setNext(push);
-                            push->setPrev(prev_tail);
-                            push->setNext(tail_node);
-                            tail_node->setPrev(push);
-                        }
-                        push = temp;
-                    }
-                }
-
-                //return the index of the associativity in the row that the tag is in
-                int inTags(int tag) {
-                    for (int i=0; i < size; ++i) {
-                        if (tags[i] == tag && valid[i] == 1) {
-                            return i;
-                        }
-                    }
-                    return -1;
-                }
-
-                uint16_t getVal(int assoc, int index) {
-                    return values[assoc][index];
-                }
-
-                vector<uint16_t> getBlock(int assoc) {
-                    return values[assoc];
-                }
-
-                void setRow(int assoc, int tag, vector<uint16_t> vals) {
-                    valid[assoc] = 1;
-                    tags[assoc] = tag;
-                    values[assoc] = vals;
-                }
-
-                void setRowVal(int assoc, int index, uint16_t val) {
-                    values[assoc][index] = val;
-                }
-            
-            private:
-                //variables for Row class
-                const int size;
-                vector<int> valid;
-                vector<int> tags;
-                vector<vector<uint16_t>> values;
-                Node* head_node;
-                Node* tail_node;
-        };
-        
-    public:
-        Cache(const int Size, const int associativity, const int BlockSize, const string Name) :
-        total_size(Size), blocksize(BlockSize), name(Name)
-        {
-            //initialize the rows for the cache
-            for (int i=0; i < (total_size/(associativity*blocksize)); ++i) {
-                rows.push_back(new Row(associativity, blocksize));
-            }
-            print_cache_config(name, total_size, associativity, blocksize, rows.size());
-        }
-        //variabels for Cache
-        int total_size;
-        int blocksize;
-        vector<Row*> rows;
-        string name;
-
-
-        //return val from cache or memory for single cache
-        uint16_t getVal(uint16_t addr, unsigned mem[], unsigned pc) {
-            //obtain relevant numbers
-            int blockid = addr/blocksize;
-            int row = blockid % rows.size();
-            int tag = blockid / rows.size();
-            int assoc = rows[row]->inTags(tag);
-            int index = addr % blocksize;
-            
-            if (assoc != -1) {
-                //if hit then move the accessed associativity to the end of LRU
-                //and return val
-                rows[row]->pushToTail(assoc);
-                print_log_entry(name, "HIT", pc, addr, row);
-                return rows[row]->getVal(assoc, index);
-            }
-            else {
-                //if miss then write block from memory into row and return val
-                vector<uint16_t> vals;
-                for (int i = blockid*blocksize; i < ((blockid+1)*blocksize); ++i) {vals.push_back(mem[i]);}
-                int LRU = rows[row]->getLRU();
-                rows[row]->setRow(LRU, tag, vals);
-                print_log_entry(name, "MISS", pc, addr, row);
-                return rows[row]->getVal(LRU, index);
-            }
-        }
-
-        //return val from cache or memory for double cache
-        uint16_t doubleCacheGetVal(uint16_t addr, unsigned mem[], Cache L2, unsigned pc) {
-            //obtain relevant numbers for both caches
-            int L1blockid = addr/blocksize;
-            int L1row = L1blockid % rows.size();
-            int L1tag = L1blockid / rows.size();
-            int L1index = addr % blocksize;
-            int assoc = rows[L1row]->inTags(L1tag);
-
-            int L2blockid = addr/L2.blocksize;
-            int L2row = L2blockid % L2.rows.size();
-            int L2tag = L2blockid / L2.rows.size();
-            int L2index = addr % L2.blocksize;
-            int L2assoc = L2.rows[L2row]->inTags(L2tag);
-
-            if (assoc != -1) {
-                //if hit in L1 then push L1 associativity to end of LRU
-                //print log and return val
-                rows[L1row]->pushToTail(assoc);
-                print_log_entry(name, "HIT", pc, addr, L1row);
-                return rows[L1row]->getVal(assoc, L1index);
-            }
-            else if (assoc == -1 && L2assoc != -1) {
-                //if miss L1 hit L2
-                //move vals from L2 into L1 and move L2 associativity to end of LRU
-                vector<uint16_t> vals;
-                for (int i = L1blockid*blocksize; i < ((L1blockid+1)*blocksize); ++i) {vals.push_back(mem[i]);}
-                L2.rows[L2row]->pushToTail(L2assoc);
-                //write vals into L1
-                int LRU = rows[L1row]->getLRU();
-                rows[L1row]->setRow(LRU, L1tag, vals);
-                //print log and return val
-                print_log_entry(name, "MISS", pc, addr, L1row);
-                print_log_entry(L2.name, "HIT", pc, addr, L2row);
-                return rows[L1row]->getVal(LRU, L1index);
-            }
-            else if (assoc == -1 && L2assoc == -1) {
-                //if both caches miss copy data from memory into both caches
-                vector<uint16_t> L1vals;
-                vector<uint16_t> L2vals;
-                for (int i = L1blockid*blocksize; i < ((L1blockid+1)*blocksize); ++i) {L1vals.push_back(mem[i]);}
-                for (int i = L2blockid*L2.blocksize; i < ((L2blockid+1)*L2.blocksize); ++i) {L2vals.push_back(mem[i]);}
-                //get LRU and put data into row for L1 and L2
-                int L2_LRU = L2.rows[L2row]->getLRU();
-                L2.rows[L2row]->setRow(L2_LRU, L2tag, L2vals);
-                int LRU = rows[L1row]->getLRU();
-                rows[L1row]->setRow(LRU, L1tag, L1vals);
-                //print log and return val
-                print_log_entry(name, "MISS", pc, addr, L1row);
-                print_log_entry(L2.name, "MISS", pc, addr, L2row);
-                return rows[L1row]->getVal(LRU, L1index);
-            }
-            return 0;
-        }
-
-        //takes val and writes it into the cache and memory at given address for single cache
-        void setVal(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) {
-            //obtain relevant numbers
-            int blockid = addr/blocksize;
-            int row = blockid % rows.size();
-            int tag = blockid / rows.size();
-            int index = addr % blocksize;
-            int assoc = rows[row]->inTags(tag);
-
-            if (assoc != -1) {
-                //if hit, then change val in cache and move associativity to the end of LRU
-                rows[row]->setRowVal(assoc, index, val);
-                rows[row]->pushToTail(assoc);
-            }
-            else {
-                //if miss, copy vals from memory into cache and write val to cache
-                vector<uint16_t> vals;
-                for (int i = blockid*blocksize; i < ((blockid+1)*blocksize); ++i) {vals.push_back(mem[i]);}
-                int LRU = rows[row]->getLRU();
-                rows[row]->setRow(LRU, tag, vals);
-                rows[row]->setRowVal(LRU, index, val);
-            }
-            //write to memory and print log
-            mem[addr] = val;
-            print_log_entry(name, "SW", pc, addr, row);
-        }
-
-        //takes val and writes into cache and memory at given address for double cache
-        void doubleCacheSetVal(uint16_t addr, uint16_t val, unsigned mem[], Cache L2, unsigned pc) {
-            //setup relevant numbers
-            int L1blockid = addr/blocksize;
-            int L1row = L1blockid % rows.size();
-            int L1tag = L1blockid / rows.size();
-            int L1index = addr % blocksize;
-            int assoc = rows[L1row]->inTags(L1tag);
-
-            int L2blockid = addr/L2.blocksize;
-            int L2row = L2blockid % L2.rows.size();
-            int L2tag = L2blockid / L2.rows.size();
-            int L2index = addr % L2.blocksize;
-            int L2assoc = L2.rows[L2row]->inTags(L2tag);
-
-            if (assoc != -1 && L2assoc != -1) {
-                //if both hit write to caches and push both associativities to tail
-                rows[L1row]->setRowVal(assoc, L1index, val);
-                rows[L1row]->pushToTail(assoc);
-                L2.rows[L2row]->setRowVal(L2assoc, L2index, val);
-                L2.rows[L2row]->pushToTail(L2assoc);
-            }
-            else if (assoc == -1 && L2assoc != -1) {
-                //if L1 miss and L2 hit, copy vals from L2 to L1
-                vector<uint16_t> vals = L2.rows[L2row]->getBlock(L2assoc);
-                L2.rows[L2row]->pushToTail(L2assoc);
-                int LRU = rows[L1row]->getLRU();
-                rows[L1row]->setRow(LRU, L1tag, vals);
-                //write val to both caches
-                rows[L1row]->setRowVal(assoc, L1index, val);
-                L2.rows[L2row]->setRowVal(L2assoc, L2index, val);
-            }
-            else if (assoc != -1 && L2assoc == -1) {
-                //if L1 hits and L2 misses, write to L1
-                rows[L1row]->setRowVal(assoc, L1index, val);
-                //copy vals from L1 to L2
-                vector<uint16_t> vals = rows[L1row]->getBlock(assoc);
-                rows[L1row]->pushToTail(assoc);
-                int L2_LRU = L2.rows[L2row]->getLRU();
-                L2.rows[L2row]->setRow(L2_LRU, L2tag, vals);
-            }
-            else if (assoc == -1 && L2assoc == -1) {
-                //if both miss copy vals from memory to caches
-                vector<uint16_t> L1vals;
-                vector<uint16_t> L2vals;
-                for (int i = L1blockid*blocksize; i < ((L1blockid+1)*blocksize); ++i) {L1vals.push_back(mem[i]);}
-                for (int i = L2blockid*L2.blocksize; i < ((L2blockid+1)*L2.blocksize); ++i) {L2vals.push_back(mem[i]);}
-                int L2_LRU = L2.rows[L2row]->getLRU();
-                L2.rows[L2row]->setRow(L2_LRU, L2tag, L2vals);
-                int LRU = rows[L1row]->getLRU();
-                rows[L1row]->setRow(LRU, L1tag, L1vals);
-                //write val to both caches
-                rows[L1row]->setRowVal(LRU, L1index, val);
-                L2.rows[L2row]->setRowVal(L2_LRU, L2index, val);
-            }
-            //write to memory and print log
-            mem[addr] = val;
-            print_log_entry(name, "SW", pc, addr, L1row);
-            print_log_entry(L2.name, "SW", pc, addr, L2row);
-        }
-};
-
-
-
-
-
-
-
-/**
-    Main function
-    Takes command-line args as documented below
-*/
-int main(int argc, char *argv[]) {
-    /*
-        Parse the command-line arguments
-    */
-    char *filename = nullptr;
-    bool do_help = false;
-    bool arg_error = false;
-    string cache_config;
-    for (int i=1; i<argc; i++) {
-        string arg(argv[i]);
-        if (arg.rfind("-",0)==0) {
-            if (arg== "-h" || arg == "--help")
-                do_help = true;
-            else if (arg=="--cache") {
-                i++;
-                if (i>=argc)
-                    arg_error = true;
-                else
-                    cache_config = argv[i];
-            }
-            else
-                arg_error = true;
-        } else {
-            if (filename == nullptr)
-                filename = argv[i];
-            else
-                arg_error = true;
-        }
-    }
-    /* Display error message if appropriate */
-    if (arg_error || do_help || filename == nullptr) {
-        cerr << "usage " << argv[0] << " [-h] [--cache CACHE] filename" << endl << endl;
-        cerr << "Simulate E20 cache" << endl << endl;
-        cerr << "positional arguments:" << endl;
-        cerr << "  filename    The file containing machine code, typically with .bin suffix" << endl<<endl;
-        cerr << "optional arguments:"<<endl;
-        cerr << "  -h, --help  show this help message and exit"<<endl;
-        cerr << "  --cache CACHE  Cache configuration: size,associativity,blocksize (for one"<<endl;
-        cerr << "                 cache) or"<<endl;
-        cerr << "                 size,associativity,blocksize,size,associativity,blocksize"<<endl;
-        cerr << "                 (for two caches)"<<endl;
-        return 1;
-    }
-
-    ifstream f(filename);
-    if (!f.is_open())
-    {
-        cerr << "Can't open file " << filename << endl;
-        return 1;
-    }
-
-     //Setup Memory, registers, program counter, and stop
-    unsigned memory[MEM_SIZE] = { 0 };
-    unsigned regs[NUM_REGS] = { 0 };
-    unsigned pc = 0b0000000000000000;
-    bool stop = false;
-    //load the machine code into memory
-    load_machine_code(f, memory);
-    f.close();
-    // Setup registers to hold pieces of the instruction
-    uint16_t op = 0b0000000000000000;
-    uint16_t imm = 0b0000000000000000;
-    uint16_t regA = 0b0000000000000000;
-    uint16_t regB = 0b0000000000000000;
-    uint16_t regDst = 0b0000000000000000;
-
-    /* parse cache config */
-    if (cache_config.size() > 0) {
-        vector<int> parts;
-        size_t pos;
-        size_t lastpos = 0;
-        while ((pos = cache_config.find(",", lastpos)) != string::npos) {
-            parts.push_back(stoi(cache_config.substr(lastpos,pos)));
-            lastpos = pos + 1;
-        }
-        parts.push_back(stoi(cache_config.substr(lastpos)));
-        if (parts.size() == 3) {
-            int L1size = parts[0];
-            int L1assoc = parts[1];
-            int L1blocksize = parts[2];
-            Cache L1(L1size, L1assoc, L1blocksize, "L1");
-            while (stop == false) {
-                //get the instruction bits and shift to the right 13 to obtain the opcode
-                uint16_t instruction = memory[pc];
-                op = (instruction & 0b1110000000000000) >> 13;
-                //3 registers instructions
-                if (op == 0) {
-                    //get the immediate value, regA, regB, and regDst from the instruction
-                    imm = instruction & 0b0000000000001111;
-                    regA = (instruction & 0b0001110000000000) >> 10;
-                    regB = (instruction & 0b0000001110000000) >> 7;
-                    regDst = (instruction & 0b0000000001110000) >> 4;
-                    //add
-                    if (imm == 0) {
-                        //add two registers and store value into destination
-                        regs[regDst] = regs[regA] + regs[regB];
-                        pc += 1;
-                    }
-                    //sub
-                    else if (imm == 1) {
-                        //subtract two registers and store value into destination
-                        regs[regDst] = regs[regA] - regs[regB];
-                        pc += 1;
-                    }
-                    //or
-                    else if (imm == 2) {
-                        //or two registers and store value in desination
-                        regs[regDst] = regs[regA] | regs[regB];
-                        pc += 1;
-                    }
-                    //and
-                    else if (imm == 3) {
-                        //and two registers and store value in destination
-                        regs[regDst] = regs[regA] & regs[regB];
-                        pc += 1;
-                    }
-                    //slt
-                    else if (imm == 4) {
-                        //set regDst to 1 if regA < regB and 0 otherwise
-                        if (regs[regA] < regs[regB])
-                            {regs[regDst] = 1;}
-                        else
-                            {regs[regDst] = 0;}
-                        pc += 1;
-                    }
-                    //jr
-                    else if (imm == 8) {
-                        //if the immediate value is the same as the pc then it will result in a infinite loop so program is stopped if true
-                        //and jumps to value in regA otherwise
-                        if (regs[regA] == pc) {
-                            stop = true;
-                        }
-                        else {
-                            pc = regs[regA];
-                        }
-                    }
-                }
-                //0 register instructions
-                else if (op == 2 || op == 3) {
-                    //setup immmediate value from instructions
-                    imm = instruction & 0b0001111111111111;
-                    //j
-                    if (op == 2) {
-                        // if immediate value is equal to pc it results in infinite loop so program is stopped and jumps to imm otherwise
-                        if (imm == pc) {
-                            stop = true;
-                        }
-                        else {
-                            pc = imm;
-                        }
-                    }
-                    //jal
-                    else if (op == 3) {
-                        //sets value of register 7 to current memory address + 1 and jumps to immediate value
-                        //if it does not result in an infinite loop
-                        regs[7] = pc + 1;
-                        if (imm == pc) {
-                            stop = true;
-                        }
-                        else {
-                            pc = imm;
-                        }
-                    }
-                }
-                //2 registers instructions
-                else {
-                    //setup imm, and register numbers from instruction
-                    imm = instruction & 0b0000000001111111;
-                    regA = (instruction & 0b0001110000000000) >> 10;
-                    regB = (instruction & 0b0000001110000000) >> 7;
-                    //sign extends immediate value for calculations
-                    uint16_t ext_imm = sign_extend_imm7(imm);
-                    //addi
-                    if (op == 1) {
-                        //adds source reg and imm into destination
-                        regs[regB] = regs[regA] + ext_imm;
-                        regs[regB] = fix_bit_length(regs[regB]);
-                        pc += 1;
-                    }
-                    //lw
-                    else if (op == 4) {
-                        //stores the value at the memory location at immediate plus addr reg into destination
-                        //regs[regB] = memory[fix_bit_length13(ext_imm + regs[regA])];
-                        uint16_t addr = ext_imm + regs[regA];
-                        regs[regB] = L1.getVal(addr, memory, pc);
-                        pc += 1;
-                    }
-                    //sw 
-                    else if (op == 5) {
-                        //stores value in source register into memory cell located from sum of immediate and value at addr register
-                        //memory[fix_bit_length13(ext_imm + regs[regA])] = regs[regB];
-                        uint16_t addr = ext_imm + regs[regA];
-                        L1.setVal(addr, regs[regB], memory, pc);
-                        pc += 1;
-                    }
-                    //jeq
-                    else if (op == 6) {
-                        //checks if two registers are equal and jumps if true, increments by one otherwise
-                        if (regs[regA] == regs[regB]) {
-                            if ((pc + ext_imm + 0b1) % 128 == pc) {
-                                stop = true;
-                            }
-                            else {
-                                pc = (pc + ext_imm + 0b1)%128;
-                            }
-                        }
-                        else {
-                            pc += 1;
-                        }
-                        
-                    }
-                    //slti
-                    else if (op == 7) {
-                        //checks if register value is less than immediate value and set destination to 1 or 0 accordingly
-                        regs[regB] = (regs[regA] < ext_imm) ? 1:0;
-                        pc += 1;
-                    }
-                }
-                
-                //ensure pc is within range
-                pc &= 0b1111111111111;
-
-                //ensure all register values are greater than 0 and less than reg_size, and wraparound if otherwise
-                for (unsigned i : regs) {
-                    i &= 0b1111111111111111;
-                }
-
-                //make sure register 0 is 0
-                regs[0] = 0b0000000000000000;
-            }
-            
-            return 0;
-                } else if (parts.size() == 6) {
-                    int L1size = parts[0];
-                    int L1assoc = parts[1];
-                    int L1blocksize = parts[2];
-                    int L2size = parts[3];
-                    int L2assoc = parts[4];
-                    int L2blocksize = parts[5];
-
-                    //Initialize the two caches
-                    Cache L1(L1size, L1assoc, L1blocksize, "L1");
-                    Cache L2(L2size, L2assoc, L2blocksize, "L2");
-
-                    while (stop == false) {
-                        //get the instruction bits and shift to the right 13 to obtain the opcode
-                        uint16_t instruction = memory[pc];
-                        op = (instruction & 0b1110000000000000) >> 13;
-                        //3 registers instructions
-                        if (op == 0) {
-                            //get the immediate value, regA, regB, and regDst from the instruction
-                            imm = instruction & 0b0000000000001111;
-                            regA = (instruction & 0b0001110000000000) >> 10;
-                            regB = (instruction & 0b0000001110000000) >> 7;
-                            regDst = (instruction & 0b0000000001110000) >> 4;
-                            //add
-                            if (imm == 0) {
-                                //add two registers and store value into destination
-                                regs[regDst] = regs[regA] + regs[regB];
-                                pc += 1;
-                            }
-                            //sub
-                            else if (imm == 1) {
-                                //subtract two registers and store value into destination
-                                regs[regDst] = regs[regA] - regs[regB];
-                                pc += 1;
-                            }
-                            //or
-                            else if (imm == 2) {
-                                //or two registers and store value in desination
-                                regs[regDst] = regs[regA] | regs[regB];
-                                pc += 1;
-                            }
-                            //and
-                            else if (imm == 3) {
-                                //and two registers and store value in destination
-                                regs[regDst] = regs[regA] & regs[regB];
-                                pc += 1;
-                            }
-                            //slt
-                            else if (imm == 4) {
-                                //set regDst to 1 if regA < regB and 0 otherwise
-                                if (regs[regA] < regs[regB])
-                                    {regs[regDst] = 1;}
-                                else
-                                    {regs[regDst] = 0;}
-                                pc += 1;
-                            }
-                            //jr
-                            else if (imm == 8) {
-                                //if the immediate value is the same as the pc then it will result in a infinite loop so program is stopped if true
-                                //and jumps to value in regA otherwise
-                                if (regs[regA] == pc) {
-                                    stop = true;
-                                }
-                                else {
-                                    pc = regs[regA];
-                                }
-                            }
-                        }
-                        //0 register instructions
-                        else if (op == 2 || op == 3) {
-                            //setup immmediate value from instructions
-                            imm = instruction & 0b0001111111111111;
-                            //j
-                            if (op == 2) {
-                                // if immediate value is equal to pc it results in infinite loop so program is stopped and jumps to imm otherwise
-                                if (imm == pc) {
-                                    stop = true;
-                                }
-                                else {
-                                    pc = imm;
-                                }
-                            }
-                            //jal
-                            else if (op == 3) {
-                                //sets value of register 7 to current memory address + 1 and jumps to immediate value
-                                //if it does not result in an infinite loop
-                                regs[7] = pc + 1;
-                                if (imm == pc) {
-                                    stop = true;
-                                }
-                                else {
-                                    pc = imm;
-                                }
-                            }
-                        }
-                        //2 registers instructions
-                        else {
-                            //setup imm, and register numbers from instruction
-                            imm = instruction & 0b0000000001111111;
-                            regA = (instruction & 0b0001110000000000) >> 10;
-                            regB = (instruction & 0b0000001110000000) >> 7;
-                            //sign extends immediate value for calculations
-                            uint16_t ext_imm = sign_extend_imm7(imm);
-                            //addi
-                            if (op == 1) {
-                                //adds source reg and imm into destination
-                                regs[regB] = regs[regA] + ext_imm;
-                                regs[regB] = fix_bit_length(regs[regB]);
-                                pc += 1;
-                            }
-                            //lw
-                            else if (op == 4) {
-                                //stores the value at the memory location at immediate plus addr reg into destination
-                                //regs[regB] = memory[fix_bit_length13(ext_imm + regs[regA])];
-                                uint16_t addr = ext_imm + regs[regA];
-                                regs[regB] = L1.doubleCacheGetVal(addr, memory, L2, pc);
-                                pc += 1;
-                            }
-                            //sw 
-                            else if (op == 5) {
-                                //stores value in source register into memory cell located from sum of immediate and value at addr register
-                                //memory[fix_bit_length13(ext_imm + regs[regA])] = regs[regB];
-                                uint16_t addr = ext_imm + regs[regA];
-                                L1.doubleCacheSetVal(addr, regs[regB], memory, L2, pc);
-                                pc += 1;
-                            }
-                            //jeq
-                            else if (op == 6) {
-                                //checks if two registers are equal and jumps if true, increments by one otherwise
-                                if (regs[regA] == regs[regB]) {
-                                    if ((pc + ext_imm + 0b1) % 128 == pc) {
-                                        stop = true;
-                                    }
-                                    else {
-                                        pc = (pc + ext_imm + 0b1)%128;
-                                    }
-                                }
-                                else {
-                                    pc += 1;
-                                }
-                                
-                            }
-                            //slti
-                            else if (op == 7) {
-                                //checks if register value is less than immediate value and set destination to 1 or 0 accordingly
-                                regs[regB] = (regs[regA] < ext_imm) ? 1:0;
-                                pc += 1;
-                            }
-                        }
-                        
-                        //ensure pc is within range
-                        pc &= 0b1111111111111;
-
-                        //ensure all register values are greater than 0 and less than reg_size, and wraparound if otherwise
-                        for (unsigned i : regs) {
-                            i &= 0b1111111111111111;
-                        }
-
-                        //make sure register 0 is 0
-                        regs[0] = 0b0000000000000000;
-                    }
-                } else {
-                    cerr << "Invalid cache config"  << endl;
-                    return 1;
-                }
-            }
-
-    return 0;
-}
-//ra0Eequ6ucie6Jei0koh6phishohm9
+/*
+CS-UY 2214
+Adapted from Jeff Epstein
+Starter code for E20 cache Simulator
+simcache.cpp
+*/
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <sstream>
+#include <memory>
+
+#include "E20machine.h"
+#include "E20cache.h"
+#include "E20multicore.h"
+#include "E20resultcache.h"
+#include "E20replay.h"
+#include "E20fixedcache.h"
+#include "E20multiprogram.h"
+#include "E20timing.h"
+#include "E20hostperf.h"
+#include "E20metrics.h"
+#include "E20trace.h"
+#include "E20autotune.h"
+
+
+using namespace std;
+
+
+/*
+    Builds the split instruction cache of --icache, if one was asked for.
+
+    @param config The --icache argument, unified for none
+    @param parts Its size, associativity and blocksize
+    @param L1 The data L1, whose log the L1I shares
+    @param tag_only Whether to keep only tags
+
+    @return The L1I, or null without --icache or when it is unified with L1
+*/
+static unique_ptr<Cache> make_icache(const string &config, const vector<int> &parts, Cache *L1, bool tag_only) {
+    unique_ptr<Cache> L1I;
+    if (config.size() > 0 && config != "unified") {
+        L1I.reset(new Cache(parts[0], parts[1], parts[2], "L1I", *L1->out));
+        if (tag_only) {L1I->keepTagsOnly();}
+    }
+    return L1I;
+}
+
+/*
+    Splits an --entry list of decimal pcs, one per core.
+
+    @param config The --entry argument
+    @param entries Receives each pc, wrapped to the address space
+
+    @return Whether every item was a number
+*/
+static bool parse_entries(const string &config, vector<unsigned> &entries) {
+    stringstream ss(config);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != string::npos || item.size() > 9) {return false;}
+        entries.push_back(atoi(item.c_str()) & 0b1111111111111);
+    }
+    //a trailing comma leaves no item behind it
+    return entries.size() > 0 && config.back() != ',';
+}
+
+/*
+    Reruns a program on uncompressed caches of the geometry a compressed run
+    had, for as many instructions, and prints each level's hit rate beside
+    the baseline's.
+
+    @param image The program's memory image
+    @param steps Instructions the compressed run executed
+    @param caches The compressed run's hierarchy, whose policy and sampling the baseline copies
+    @param icache_config The --icache argument
+    @param icache Its size, associativity and blocksize
+    @param tag_only Whether to keep only tags
+*/
+static void compare_uncompressed(const vector<unsigned> &image, unsigned long long steps, CacheHierarchy &caches,
+        const string &icache_config, const vector<int> &icache, bool tag_only) {
+    ostream discard(nullptr);
+    vector<Cache*> levels = {caches.L1};
+    if (caches.L2 != nullptr) {levels.push_back(caches.L2);}
+    vector<unique_ptr<Cache>> base;
+    for (Cache* cache : levels) {
+        base.emplace_back(new Cache(cache->total_size, cache->assoc/cache->tag_factor, cache->blocksize, cache->name, discard));
+        if (tag_only) {base.back()->keepTagsOnly();}
+    }
+    CacheHierarchy base_caches(base[0].get(), caches.L2 != nullptr ? base[1].get() : nullptr, caches.policy);
+    base_caches.sample_every = caches.sample_every;
+    unique_ptr<Cache> L1I = make_icache(icache_config, icache, base[0].get(), tag_only);
+    base_caches.I1 = L1I ? L1I.get() : icache_config.size() > 0 ? base[0].get() : nullptr;
+    E20Machine machine;
+    machine.load(image);
+    machine.attach(&base_caches);
+    machine.run(steps);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        double rate = 100.0*(levels[i]->load_hits + levels[i]->store_hits)/max(levels[i]->loads + levels[i]->stores, 1ULL);
+        double base_rate = 100.0*(base[i]->load_hits + base[i]->store_hits)/max(base[i]->loads + base[i]->stores, 1ULL);
+        cout << levels[i]->name << fixed << setprecision(2) << " hit rate " << rate << "% (uncompressed " << base_rate <<
+            "%, " << showpos << rate - base_rate << noshowpos << " points)" << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
+
+
+/**
+    Main function
+    Takes command-line args as documented below
+*/
+int main(int argc, char *argv[]) {
+    /*
+        Parse the command-line arguments
+    */
+    char *filename = nullptr;
+    bool do_help = false;
+    bool arg_error = false;
+    string cache_config;
+    int num_cores = 0;
+    int quantum = 64;
+    string entry_config;
+    vector<unsigned> entries;
+    unsigned long long max_steps = ULLONG_MAX;
+    double time_limit = 0;
+    bool detect_loops = false;
+    bool classify_misses = false;
+    string inclusion;
+    string dram_config;
+    int sample_every = 0;
+    int replay_threads = 0;
+    bool replay_summary = false;
+    vector<string> co_run;
+    unsigned long long slice = 1000;
+    string way_partition;
+    string timing_config;
+    string ooo_config;
+    unsigned mem_latency = 100;
+    bool host_perf = false;
+    bool tag_only = false;
+    string trace_file;
+    TraceFormat trace_format = TRACE_AUTO;
+    string icache_config;
+    bool icache_log = false;
+    char *result_dir = nullptr;
+    unsigned long long result_cache_mb = 256;
+    string compress_levels;
+    int compress_tags = 2;
+    string metrics_file;
+    MetricsFormat metrics_format = METRICS_JSON;
+    unsigned long long metrics_interval = 0;
+    string autotune_config;
+    string tune_latency;
+    vector<string> tune_workloads;
+    for (int i=1; i<argc; i++) {
+        string arg(argv[i]);
+        if (arg.rfind("-",0)==0) {
+            if (arg== "-h" || arg == "--help")
+                do_help = true;
+            else if (arg=="--cache") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    cache_config = argv[i];
+            }
+            else if (arg=="--detect-loops")
+                detect_loops = true;
+            else if (arg=="--host-perf")
+                host_perf = true;
+            else if (arg=="--tag-only")
+                tag_only = true;
+            else if (arg=="--classify-misses")
+                classify_misses = true;
+            else if (arg=="--dram") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    dram_config = argv[i];
+            }
+            else if (arg=="--inclusion") {
+                i++;
+                if (i>=argc || (string(argv[i]) != "non-inclusive" && string(argv[i]) != "inclusive" &&
+                        string(argv[i]) != "exclusive"))
+                    arg_error = true;
+                else
+                    inclusion = argv[i];
+            }
+            else if (arg=="--result-cache" || arg=="--result-cache-mb") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else if (arg=="--result-cache")
+                    result_dir = argv[i];
+                else
+                    result_cache_mb = strtoull(argv[i], nullptr, 10);
+            }
+            else if (arg=="--compress") {
+                i++;
+                if (i>=argc || (string(argv[i]) != "L1" && string(argv[i]) != "L2" && string(argv[i]) != "L1,L2"))
+                    arg_error = true;
+                else
+                    compress_levels = argv[i];
+            }
+            else if (arg=="--compress-tags") {
+                i++;
+                if (i>=argc || (compress_tags = atoi(argv[i])) < 2)
+                    arg_error = true;
+            }
+            else if (arg=="--metrics") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    metrics_file = argv[i];
+            }
+            else if (arg=="--metrics-format") {
+                i++;
+                if (i>=argc || (string(argv[i]) != "json" && string(argv[i]) != "prometheus"))
+                    arg_error = true;
+                else
+                    metrics_format = string(argv[i]) == "json" ? METRICS_JSON : METRICS_PROMETHEUS;
+            }
+            else if (arg=="--autotune" || arg=="--tune-latency" || arg=="--tune-workload") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else if (arg=="--autotune")
+                    autotune_config = argv[i];
+                else if (arg=="--tune-latency")
+                    tune_latency = argv[i];
+                else
+                    tune_workloads.push_back(argv[i]);
+            }
+            else if (arg=="--metrics-interval") {
+                i++;
+                if (i>=argc || (metrics_interval = strtoull(argv[i], nullptr, 10)) == 0)
+                    arg_error = true;
+            }
+            else if (arg=="--max-steps" || arg=="--time-limit") {
+                i++;
+                if (i>=argc || atof(argv[i]) <= 0)
+                    arg_error = true;
+                else if (arg=="--max-steps")
+                    max_steps = strtoull(argv[i], nullptr, 10);
+                else
+                    time_limit = atof(argv[i]);
+            }
+            else if (arg=="--replay-summary")
+                replay_summary = true;
+            else if (arg=="--replay") {
+                i++;
+                if (i>=argc || (replay_threads = atoi(argv[i])) <= 0)
+                    arg_error = true;
+            }
+            else if (arg=="--co-run" || arg=="--way-partition") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else if (arg=="--co-run")
+                    co_run.push_back(argv[i]);
+                else
+                    way_partition = argv[i];
+            }
+            else if (arg=="--icache-log")
+                icache_log = true;
+            else if (arg=="--icache") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    icache_config = argv[i];
+            }
+            else if (arg=="--trace") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    trace_file = argv[i];
+            }
+            else if (arg=="--trace-format") {
+                i++;
+                if (i>=argc || (string(argv[i]) != "auto" && string(argv[i]) != "din" && string(argv[i]) != "lackey"))
+                    arg_error = true;
+                else
+                    trace_format = string(argv[i]) == "din" ? TRACE_DIN : string(argv[i]) == "lackey" ? TRACE_LACKEY : TRACE_AUTO;
+            }
+            else if (arg=="--timing") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    timing_config = argv[i];
+            }
+            else if (arg=="--ooo") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    ooo_config = argv[i];
+            }
+            else if (arg=="--mem-latency") {
+                i++;
+                if (i>=argc || atoi(argv[i]) <= 0)
+                    arg_error = true;
+                else
+                    mem_latency = atoi(argv[i]);
+            }
+            else if (arg=="--slice") {
+                i++;
+                if (i>=argc || atof(argv[i]) <= 0)
+                    arg_error = true;
+                else
+                    slice = strtoull(argv[i], nullptr, 10);
+            }
+            else if (arg=="--sample-sets") {
+                i++;
+                if (i>=argc || (sample_every = atoi(argv[i])) <= 0)
+                    arg_error = true;
+            }
+            else if (arg=="--cores" || arg=="--quantum" || arg=="--entry") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else if (arg=="--entry") {
+                    entry_config = argv[i];
+                    if (!parse_entries(entry_config, entries))
+                        arg_error = true;
+                }
+                else {
+                    int val = atoi(argv[i]);
+                    if (val <= 0 || (arg=="--cores" && val > MAX_CORES))
+                        arg_error = true;
+                    else if (arg=="--cores")
+                        num_cores = val;
+                    else
+                        quantum = val;
+                }
+            }
+            else
+                arg_error = true;
+        } else {
+            if (filename == nullptr)
+                filename = argv[i];
+            else
+                arg_error = true;
+        }
+    }
+    if (metrics_interval > 0 && metrics_file.empty())
+        arg_error = true;
+    //every entry pc belongs to a core
+    if (entries.size() > (size_t)num_cores)
+        arg_error = true;
+    if ((tune_latency.size() > 0 || tune_workloads.size() > 0) && autotune_config.empty())
+        arg_error = true;
+    /* Display error message if appropriate */
+    if (arg_error || do_help || (filename == nullptr) == trace_file.empty()) {
+        cerr << "usage " << argv[0] << " [-h] [--cache CACHE] [--cores N] [--entry PCS] [--quantum Q]" << endl;
+        cerr << "       [--max-steps N] [--time-limit SECONDS] [--detect-loops]" << endl;
+        cerr << "       [--classify-misses] [--inclusion POLICY] [--dram DRAM]" << endl;
+        cerr << "       [--sample-sets K] [--replay THREADS] [--replay-summary]" << endl;
+        cerr << "       [--co-run FILE]... [--slice Q] [--way-partition WAYS]" << endl;
+        cerr << "       [--timing TIMING] [--ooo OOO] [--mem-latency CYCLES] [--host-perf] [--tag-only]" << endl;
+        cerr << "       [--icache ICACHE] [--icache-log] [--metrics FILE] [--metrics-format FORMAT]" << endl;
+        cerr << "       [--metrics-interval N] [--compress LEVELS] [--compress-tags K]" << endl;
+        cerr << "       [--result-cache DIR] [--result-cache-mb MB] filename" << endl;
+        cerr << "       " << argv[0] << " --cache CACHE --trace TRACE [--trace-format FORMAT]" << endl;
+        cerr << "       " << argv[0] << " --autotune BUDGET [--tune-latency LATENCY]" << endl;
+        cerr << "       [--tune-workload FILE]... [--max-steps N] filename" << endl << endl;
+        cerr << "Simulate E20 cache" << endl << endl;
+        cerr << "positional arguments:" << endl;
+        cerr << "  filename    The file containing machine code, typically with .bin suffix" << endl<<endl;
+        cerr << "optional arguments:"<<endl;
+        cerr << "  -h, --help  show this help message and exit"<<endl;
+        cerr << "  --cache CACHE  Cache configuration: size,associativity,blocksize (for one"<<endl;
+        cerr << "                 cache) or"<<endl;
+        cerr << "                 size,associativity,blocksize,size,associativity,blocksize"<<endl;
+        cerr << "                 (for two caches)"<<endl;
+        cerr << "  --cores N      Run N cores over shared memory, each with a private L1 kept"<<endl;
+        cerr << "                 coherent with MESI (the L2, if given, is shared); at most " << MAX_CORES <<endl;
+        cerr << "  --entry PCS    Comma separated entry pc of each core, at most one per core"<<endl;
+        cerr << "                 (default 0, the last one given repeats for the rest)"<<endl;
+        cerr << "  --quantum Q    Most instructions each core runs between synchronizations"<<endl;
+        cerr << "                 (default 64); every lw and sw also ends the quantum, so Q"<<endl;
+        cerr << "                 only bounds runs of other instructions"<<endl;
+        cerr << "  --max-steps N  Stop after N instructions (exit status " << EXIT_BUDGET << ")"<<endl;
+        cerr << "  --time-limit SECONDS"<<endl;
+        cerr << "                 Stop after SECONDS of wall-clock time (exit status " << EXIT_BUDGET << ")"<<endl;
+        cerr << "  --detect-loops Stop when the machine provably loops forever (exit status " << EXIT_STUCK << ");"<<endl;
+        cerr << "                 single core only"<<endl;
+        cerr << "  --classify-misses"<<endl;
+        cerr << "                 Split each cache's misses into compulsory, capacity, conflict"<<endl;
+        cerr << "                 and coherence, and print per-row access and miss counts"<<endl;
+        cerr << "  --inclusion POLICY"<<endl;
+        cerr << "                 How the L2 relates to the L1: non-inclusive (default),"<<endl;
+        cerr << "                 inclusive or exclusive; two caches, single core only"<<endl;
+        cerr << "  --dram DRAM    Time memory as DRAM: banks,rowsize,open|closed,tRCD,tCAS,tRP"<<endl;
+        cerr << "                 (rowsize in cells, latencies in cycles); single core only"<<endl;
+        cerr << "  --sample-sets K"<<endl;
+        cerr << "                 Simulate only every K-th L1 row and estimate the misses of"<<endl;
+        cerr << "                 the whole run with 95% error bounds; single core only, and"<<endl;
+        cerr << "                 every L2 set must map to a single L1 row"<<endl;
+        cerr << "  --replay THREADS"<<endl;
+        cerr << "                 Record the run's accesses, then replay them through the"<<endl;
+        cerr << "                 cache on THREADS threads split by row; one cache only"<<endl;
+        cerr << "  --replay-summary"<<endl;
+        cerr << "                 With --replay, print per-row hit and miss counts instead"<<endl;
+        cerr << "                 of the log"<<endl;
+        cerr << "  --co-run FILE  Time-slice FILE with filename on the same caches, each program"<<endl;
+        cerr << "                 in its own memory, and compare each one's hits with a run"<<endl;
+        cerr << "                 alone; repeat for up to " << MAX_PROGRAMS << " programs, single core only"<<endl;
+        cerr << "  --slice Q      Instructions each co-running program runs per turn"<<endl;
+        cerr << "                 (default 1000)"<<endl;
+        cerr << "  --way-partition WAYS"<<endl;
+        cerr << "                 Comma separated ways of the last cache level each co-running"<<endl;
+        cerr << "                 program may fill, in program order"<<endl;
+        cerr << "  --timing TIMING"<<endl;
+        cerr << "                 Time the run with non-blocking caches: hitlatency,mshrs for"<<endl;
+        cerr << "                 each cache, and print cycles, stalls and memory-level"<<endl;
+        cerr << "                 parallelism instead of the log; single core only"<<endl;
+        cerr << "  --ooo OOO      Under --timing, model an out-of-order core of"<<endl;
+        cerr << "                 robsize,width,lsqsize instead of the in-order one"<<endl;
+        cerr << "  --mem-latency CYCLES"<<endl;
+        cerr << "                 Memory latency under --timing without --dram (default 100)"<<endl;
+        cerr << "  --icache ICACHE"<<endl;
+        cerr << "                 Fetch instructions through an L1 instruction cache of"<<endl;
+        cerr << "                 size,associativity,blocksize, or through the data L1 with"<<endl;
+        cerr << "                 unified; the L2 is shared. Single core, non-inclusive only"<<endl;
+        cerr << "  --icache-log   Log every fetch as IF HIT or IF MISS at its pc"<<endl;
+        cerr << "  --trace TRACE  Instead of an E20 program, run the memory trace in TRACE (- for"<<endl;
+        cerr << "                 stdin) through the caches and print hits and misses; sizes"<<endl;
+        cerr << "                 are in the trace's address units, usually bytes, and"<<endl;
+        cerr << "                 --max-steps caps the records read"<<endl;
+        cerr << "  --trace-format FORMAT"<<endl;
+        cerr << "                 din (Dinero \"label address [size]\"), lackey (Valgrind"<<endl;
+        cerr << "                 \"L/S/M address,size\") or auto (default, by line)"<<endl;
+        cerr << "  --autotune BUDGET"<<endl;
+        cerr << "                 Instead of simulating one cache, search the one and two level"<<endl;
+        cerr << "                 configurations within a BUDGET of cells,maxassociativity and"<<endl;
+        cerr << "                 print the Pareto frontier of miss rate against size"<<endl;
+        cerr << "  --tune-latency LATENCY"<<endl;
+        cerr << "                 With --autotune, rank by average access cycles instead: a"<<endl;
+        cerr << "                 level of S cells hits in base+perdoubling*log2(S) cycles and"<<endl;
+        cerr << "                 memory takes memory, given as base,perdoubling,memory"<<endl;
+        cerr << "  --tune-workload FILE"<<endl;
+        cerr << "                 Add FILE to the programs --autotune sums misses over"<<endl;
+        cerr << "  --tag-only     Keep only tags and LRU state in the caches and serve loads"<<endl;
+        cerr << "                 from memory, which stores write through; same output"<<endl;
+        cerr << "  --host-perf    Print the host time, cycles, instructions, branch misses and"<<endl;
+        cerr << "                 LLC misses of the load, simulate and output phases to stderr"<<endl;
+        cerr << "                 (the log is written while simulating), with simulated"<<endl;
+        cerr << "                 instructions per host second"<<endl;
+        cerr << "  --compress LEVELS"<<endl;
+        cerr << "                 Store the blocks of L1, L2 or L1,L2 compressed with base-delta"<<endl;
+        cerr << "                 or zero-value encoding, each row holding as many as fit in"<<endl;
+        cerr << "                 its data space, and print the compression ratio, effective"<<endl;
+        cerr << "                 capacity and hit rates against an uncompressed rerun; single"<<endl;
+        cerr << "                 core, without --co-run, --timing, --replay or --inclusion exclusive"<<endl;
+        cerr << "  --compress-tags K"<<endl;
+        cerr << "                 Tags per way of data space in a compressed level (default 2,"<<endl;
+        cerr << "                 at most 64 tags per row in all)"<<endl;
+        cerr << "  --metrics FILE Write instructions retired in all and by opcode, each cache's"<<endl;
+        cerr << "                 loads, stores, hits, misses and evictions, where accesses"<<endl;
+        cerr << "                 and fetches were served, and the host time of the load and"<<endl;
+        cerr << "                 simulate phases to FILE at the end; single core only,"<<endl;
+        cerr << "                 without --co-run, --timing or --replay"<<endl;
+        cerr << "  --metrics-format FORMAT"<<endl;
+        cerr << "                 json (default, one object per line) or prometheus (text"<<endl;
+        cerr << "                 format, the file replaced by each snapshot)"<<endl;
+        cerr << "  --metrics-interval N"<<endl;
+        cerr << "                 Also write metrics every N instructions"<<endl;
+        cerr << "  --result-cache DIR"<<endl;
+        cerr << "                 Reuse the output of identical earlier runs stored in DIR"<<endl;
+        cerr << "                 (not used with --time-limit or --metrics)"<<endl;
+        cerr << "  --result-cache-mb MB"<<endl;
+        cerr << "                 Evict least recently used results past MB megabytes"<<endl;
+        cerr << "                 (default 256, 0 for no limit)"<<endl;
+        return 1;
+    }
+
+    //traces of other machines only need the caches' tags, at the trace's address width
+    if (!trace_file.empty()) {
+        vector<int> parts;
+        stringstream ss(cache_config);
+        string item;
+        while (getline(ss, item, ',')) {parts.push_back(atoi(item.c_str()));}
+        if (parts.size() != 3 && parts.size() != 6) {
+            cerr << "Invalid cache config"  << endl;
+            return 1;
+        }
+        if (num_cores > 0 || co_run.size() > 0 || timing_config.size() > 0 || replay_threads > 0 || sample_every > 0 ||
+                classify_misses || inclusion.size() > 0 || dram_config.size() > 0 || icache_config.size() > 0 ||
+                metrics_file.size() > 0 || compress_levels.size() > 0) {
+            cerr << "--trace runs one or two caches alone, without the E20 modes" << endl;
+            return 1;
+        }
+        ifstream tf;
+        if (trace_file != "-") {
+            tf.open(trace_file, ios::binary);
+            if (!tf.is_open()) {
+                cerr << "Can't open file " << trace_file << endl;
+                return 1;
+            }
+        }
+        Cache L1(parts[0], parts[1], parts[2], "L1");
+        unique_ptr<Cache> L2;
+        if (parts.size() == 6) {L2.reset(new Cache(parts[3], parts[4], parts[5], "L2"));}
+        L1.keepTagsOnly();
+        if (L2) {L2->keepTagsOnly();}
+        TraceReader reader(trace_file == "-" ? cin : tf, trace_format);
+        TraceHierarchy caches(&L1, L2.get());
+        TraceRecord record;
+        unsigned long long records = 0;
+        while (records < max_steps && reader.next(record)) {
+            caches.access(record);
+            records++;
+        }
+        caches.print(cout, reader);
+        return 0;
+    }
+
+    //the tuner records each workload once and searches caches of its own over the accesses
+    if (!autotune_config.empty()) {
+        vector<int> budget;
+        vector<double> latency;
+        stringstream ss(autotune_config);
+        string item;
+        while (getline(ss, item, ',')) {budget.push_back(atoi(item.c_str()));}
+        if (budget.size() != 2 || budget[0] <= 0 || budget[1] <= 0 || budget[1] > 255) {
+            cerr << "Invalid autotune config" << endl;
+            return 1;
+        }
+        if (tune_latency.size() > 0) {
+            stringstream ls(tune_latency);
+            while (getline(ls, item, ',')) {latency.push_back(atof(item.c_str()));}
+            bool valid = latency.size() == 3;
+            for (double val : latency) {valid = valid && val >= 0;}
+            if (!valid) {
+                cerr << "Invalid tune latency" << endl;
+                return 1;
+            }
+        }
+        if (cache_config.size() > 0 || num_cores > 0 || co_run.size() > 0 || timing_config.size() > 0 ||
+                replay_threads > 0 || sample_every > 0 || classify_misses || inclusion.size() > 0 ||
+                dram_config.size() > 0 || icache_config.size() > 0 || metrics_file.size() > 0 ||
+                compress_levels.size() > 0 || detect_loops) {
+            cerr << "--autotune picks the caches itself, without --cache or the other modes" << endl;
+            return 1;
+        }
+        Autotuner tuner(budget[0], budget[1], latency);
+        tune_workloads.insert(tune_workloads.begin(), filename);
+        for (const string &name : tune_workloads) {
+            ifstream wf(name);
+            if (!wf.is_open()) {
+                cerr << "Can't open file " << name << endl;
+                return 1;
+            }
+            E20Machine workload;
+            workload.load(wf);
+            TraceRecorder recorder;
+            workload.attach(&recorder);
+            Watchdog watchdog(max_steps, time_limit, false);
+            //a workload cut short by the limits is tuned on the accesses it made
+            run_watched(workload, watchdog);
+            tuner.workloads.push_back(recorder.trace);
+        }
+        tuner.search();
+        tuner.print(cout);
+        return 0;
+    }
+
+    //host counters around the phases of the run, when asked for
+    unique_ptr<HostPerf> perf;
+    if (host_perf) {
+        perf.reset(new HostPerf());
+        perf->start("load");
+    }
+    //metrics read the counters of the run's machine and caches, so only runs with one of each export them
+    unique_ptr<Metrics> metrics;
+    if (metrics_file.size() > 0) {
+        if (num_cores > 0 || co_run.size() > 0 || timing_config.size() > 0 || replay_threads > 0) {
+            cerr << "--metrics needs a single core, without --co-run, --timing or --replay" << endl;
+            return 1;
+        }
+        metrics.reset(new Metrics(metrics_file, metrics_format));
+        if (!metrics->ok) {
+            cerr << "Can't open file " << metrics_file << endl;
+            return 1;
+        }
+        metrics->phase("load");
+    }
+
+    ifstream f(filename);
+    if (!f.is_open())
+    {
+        cerr << "Can't open file " << filename << endl;
+        return 1;
+    }
+
+    //Setup the machine and load the machine code into memory
+    E20Machine machine;
+    machine.load(f);
+    f.close();
+    unsigned *memory = machine.memory;
+    //images of the programs run alongside it, in program order after filename
+    vector<vector<unsigned>> images(1, vector<unsigned>(memory, memory + MEM_SIZE));
+    for (const string &name : co_run) {
+        ifstream cf(name);
+        if (!cf.is_open()) {
+            cerr << "Can't open file " << name << endl;
+            return 1;
+        }
+        E20Machine co;
+        co.load(cf);
+        images.push_back(vector<unsigned>(co.memory, co.memory + MEM_SIZE));
+    }
+    Watchdog watchdog(max_steps, time_limit, detect_loops);
+    int status = 0;
+    if (metrics) {
+        machine.countOpcodes();
+        add_machine_metrics(*metrics, machine);
+        if (metrics_interval > 0) {watchdog.every(metrics_interval, [&](unsigned long long) {metrics->write(false);});}
+    }
+
+    /* parse cache config */
+    if (cache_config.size() > 0) {
+        vector<int> parts;
+        size_t pos;
+        size_t lastpos = 0;
+        while ((pos = cache_config.find(",", lastpos)) != string::npos) {
+            parts.push_back(stoi(cache_config.substr(lastpos,pos)));
+            lastpos = pos + 1;
+        }
+        parts.push_back(stoi(cache_config.substr(lastpos)));
+        if (parts.size() != 3 && parts.size() != 6) {
+            cerr << "Invalid cache config"  << endl;
+            return 1;
+        }
+        InclusionPolicy policy = inclusion == "inclusive" ? INCLUSIVE : inclusion == "exclusive" ? EXCLUSIVE : NON_INCLUSIVE;
+        if (inclusion.size() > 0 && (parts.size() != 6 || num_cores > 0)) {
+            cerr << "--inclusion needs two caches and a single core" << endl;
+            return 1;
+        }
+        unique_ptr<DramModel> dram;
+        if (dram_config.size() > 0) {
+            dram.reset(DramModel::parse(dram_config));
+            if (!dram || num_cores > 0) {
+                cerr << "Invalid DRAM config" << endl;
+                return 1;
+            }
+        }
+        if (sample_every > 0 && num_cores > 0) {
+            cerr << "--sample-sets needs a single core" << endl;
+            return 1;
+        }
+        //rows are sampled by their L1 row, so each L2 set must only ever hold blocks of one L1 row;
+        //that holds when L2 blocks split L1 blocks and L2 sets are a whole multiple of L1 rows
+        if (sample_every > 0 && parts.size() == 6) {
+            int L1_rows = parts[0]/(parts[1]*parts[2]);
+            int L2_rows = parts[3]/(parts[4]*parts[5]);
+            if (parts[2] % parts[5] != 0 || L2_rows % (parts[2]/parts[5]*L1_rows) != 0) {
+                cerr << "--sample-sets needs an L2 blocksize dividing the L1's and an L2 row count" << endl;
+                cerr << "that is a multiple of L1 rows times L1 blocksize over L2 blocksize" << endl;
+                return 1;
+            }
+        }
+        //the cores only consult the watchdog's limits, never its loop detection
+        if (detect_loops && num_cores > 0) {
+            cerr << "--detect-loops needs a single core" << endl;
+            return 1;
+        }
+        //false sharing is found from a 64-bit mask of the words each L1 block has touched
+        if (num_cores > 0 && parts[2] > 64) {
+            cerr << "--cores needs an L1 blocksize of at most 64" << endl;
+            return 1;
+        }
+        //the replay only models the cache's tags, so nothing else may watch the accesses
+        if (replay_threads > 0 && (parts.size() != 3 || num_cores > 0 || dram || sample_every > 0 || classify_misses)) {
+            cerr << "--replay needs one cache and a single core, without --dram, --sample-sets or --classify-misses" << endl;
+            return 1;
+        }
+        //each co-running program gets a consecutive range of the last level's ways
+        vector<uint64_t> program_ways(images.size(), ~uint64_t(0));
+        if (co_run.size() > 0 || way_partition.size() > 0) {
+            if (co_run.empty() || images.size() > MAX_PROGRAMS || num_cores > 0 || sample_every > 0 ||
+                    replay_threads > 0 || detect_loops) {
+                cerr << "--co-run needs a single core and at most " << MAX_PROGRAMS <<
+                    " programs, without --sample-sets, --replay or --detect-loops" << endl;
+                return 1;
+            }
+            if (way_partition.size() > 0) {
+                //partitions are masks of the first 64 ways, so they must cover the whole level
+                int last_assoc = parts.size() == 6 ? parts[4] : parts[1];
+                if (last_assoc > 64) {
+                    cerr << "--way-partition needs a last cache level of at most 64 ways" << endl;
+                    return 1;
+                }
+                int used = 0;
+                size_t program = 0;
+                stringstream ss(way_partition);
+                string item;
+                while (getline(ss, item, ',')) {
+                    int ways = atoi(item.c_str());
+                    if (program >= images.size() || ways <= 0 || used + ways > last_assoc || used + ways > 64) {
+                        program = images.size() + 1;
+                        break;
+                    }
+                    program_ways[program++] = (ways == 64 ? ~uint64_t(0) : (uint64_t(1) << ways) - 1) << used;
+                    used += ways;
+                }
+                if (program != images.size()) {
+                    cerr << "Invalid way partition" << endl;
+                    return 1;
+                }
+            }
+        }
+        vector<int> timing;
+        if (timing_config.size() > 0) {
+            stringstream ss(timing_config);
+            string item;
+            while (getline(ss, item, ',')) {timing.push_back(atoi(item.c_str()));}
+            bool valid = timing.size() == parts.size()/3*2;
+            for (int val : timing) {valid = valid && val > 0;}
+            if (!valid) {
+                cerr << "Invalid timing config" << endl;
+                return 1;
+            }
+            //the timed levels keep their own tags, non-inclusive and unsampled
+            if (num_cores > 0 || co_run.size() > 0 || replay_threads > 0 || sample_every > 0 ||
+                    classify_misses || inclusion.size() > 0 || detect_loops) {
+                cerr << "--timing needs a single core, without --co-run, --replay, --sample-sets," << endl;
+                cerr << "--classify-misses, --inclusion or --detect-loops" << endl;
+                return 1;
+            }
+        }
+        //reorder buffer entries, issue width and load/store queue entries of an out-of-order core
+        vector<int> ooo;
+        if (ooo_config.size() > 0) {
+            stringstream ss(ooo_config);
+            string item;
+            while (getline(ss, item, ',')) {ooo.push_back(atoi(item.c_str()));}
+            bool valid = ooo.size() == 3;
+            for (int val : ooo) {valid = valid && val > 0;}
+            if (!valid) {
+                cerr << "Invalid ooo config" << endl;
+                return 1;
+            }
+            if (timing.size() == 0) {
+                cerr << "--ooo needs --timing" << endl;
+                return 1;
+            }
+        }
+        //instruction fetch goes through a split L1I or the data L1
+        vector<int> icache;
+        if (icache_config.size() > 0 || icache_log) {
+            if (icache_config != "unified") {
+                stringstream ss(icache_config);
+                string item;
+                while (getline(ss, item, ',')) {icache.push_back(atoi(item.c_str()));}
+                if (icache.size() != 3) {
+                    cerr << "Invalid icache config" << endl;
+                    return 1;
+                }
+            }
+            if (num_cores > 0 || co_run.size() > 0 || timing.size() > 0 || replay_threads > 0 || policy != NON_INCLUSIVE) {
+                cerr << "--icache needs a single core and the non-inclusive policy, without --co-run," << endl;
+                cerr << "--timing or --replay" << endl;
+                return 1;
+            }
+        }
+        //compressed rows evict blocks of their own accord, which only the one-program,
+        //write-through levels handle; exclusive victims and MESI states would be lost
+        if (compress_levels.size() > 0 && (num_cores > 0 || co_run.size() > 0 || timing.size() > 0 ||
+                replay_threads > 0 || policy == EXCLUSIVE || (compress_levels != "L1" && parts.size() != 6))) {
+            cerr << "--compress needs a single core and a level that exists, without --co-run, --timing," << endl;
+            cerr << "--replay or --inclusion exclusive" << endl;
+            return 1;
+        }
+        //a compressed level has compress_tags times the ways, kept within what a way mask can name
+        if (compress_levels.size() > 0) {
+            bool valid = compress_tags <= 64;
+            if (compress_levels != "L2") {valid = valid && parts[1]*compress_tags <= 64;}
+            if (compress_levels != "L1") {valid = valid && parts[4]*compress_tags <= 64;}
+            if (!valid) {
+                cerr << "--compress-tags needs associativity times K of at most 64 in each compressed level" << endl;
+                return 1;
+            }
+        }
+        //inclusive back-invalidation walks L1 blocks inside an L2 block, exclusive swaps whole blocks
+        if ((policy == INCLUSIVE && parts[5] % parts[2] != 0) || (policy == EXCLUSIVE && parts[5] != parts[2])) {
+            cerr << "Invalid cache config for " << inclusion_name(policy) << " policy" << endl;
+            return 1;
+        }
+
+        //as in E20sim, only runs the wall clock cannot cut short and without metrics are cached;
+        //the run string names every option that changes the output
+        unique_ptr<CachedRun> cached;
+        if (result_dir != nullptr && time_limit == 0 && !metrics) {
+            string run = "E20cachesim cache=";
+            for (int part : parts) {run += to_string(part) + ",";}
+            run += " max_steps=" + to_string(max_steps) + (detect_loops ? " detect_loops" : "");
+            if (classify_misses) {run += " classify_misses";}
+            if (inclusion.size() > 0) {run += " inclusion=" + inclusion;}
+            if (dram) {run += " dram=" + dram_config;}
+            if (sample_every > 0) {run += " sample_sets=" + to_string(sample_every);}
+            //the thread count does not change the output, only the summary flag does
+            if (replay_summary && replay_threads > 0) {run += " replay_summary";}
+            for (size_t i = 1; i < images.size(); ++i) {run += " co_run=" + ResultCache::key(images[i].data(), "");}
+            //a co-run prints each program's filename, so they are part of its output
+            if (co_run.size() > 0) {
+                run += " names=" + string(filename);
+                for (const string &name : co_run) {run += "," + name;}
+            }
+            if (icache_config.size() > 0) {run += " icache=" + icache_config + (icache_log ? " icache_log" : "");}
+            if (compress_levels.size() > 0) {run += " compress=" + compress_levels + " compress_tags=" + to_string(compress_tags);}
+            if (timing.size() > 0) {run += " timing=" + timing_config + " mem_latency=" + to_string(mem_latency);}
+            if (ooo.size() > 0) {run += " ooo=" + ooo_config;}
+            if (co_run.size() > 0) {run += " slice=" + to_string(slice) + " way_partition=" + way_partition;}
+            if (num_cores > 0) {
+                run += " cores=" + to_string(num_cores) + " entry=" + entry_config + " quantum=" + to_string(quantum);
+            }
+            cached.reset(new CachedRun(result_dir, result_cache_mb << 20, memory, run));
+            if (cached->replay(status)) {
+                if (perf) {perf->print(cerr, 0);}
+                return status;
+            }
+        }
+
+        if (perf) {perf->start("simulate");}
+        if (metrics) {metrics->phase("simulate");}
+        unsigned long long simulated = 0;
+        if (timing.size() > 0) {
+            Cache L1(parts[0], parts[1], parts[2], "L1");
+            unique_ptr<Cache> L2;
+            if (parts.size() == 6) {L2.reset(new Cache(parts[3], parts[4], parts[5], "L2"));}
+            //the timed levels never read block data
+            L1.keepTagsOnly();
+            if (L2) {L2->keepTagsOnly();}
+            EventQueue queue;
+            TimedMemory main_memory(queue, mem_latency, dram.get());
+            unique_ptr<TimedCache> timed_L2;
+            if (L2) {timed_L2.reset(new TimedCache(queue, *L2, timing[2], timing[3], &main_memory, memory));}
+            TimedCache timed_L1(queue, L1, timing[0], timing[1],
+                timed_L2 ? (TimedLevel*)timed_L2.get() : &main_memory, memory);
+            if (ooo.size() > 0) {
+                OooCore core(machine, queue, timed_L1, ooo[0], ooo[1], ooo[2]);
+                status = core.run(watchdog);
+                core.print(cout);
+            } else {
+                TimingCore core(machine, queue, timed_L1);
+                status = core.run(watchdog);
+                core.print(cout);
+            }
+            timed_L1.print(cout);
+            if (timed_L2) {timed_L2->print(cout);}
+            cout << "Memory requests " << main_memory.requests << ", events " << queue.handled << endl;
+        } else if (co_run.size() > 0) {
+            //the shared run logs every access, at the physical address of its program's partition
+            vector<unsigned> physical(MAX_PROGRAMS*MEM_SIZE, 0);
+            Cache L1(parts[0], parts[1], parts[2], "L1");
+            unique_ptr<Cache> L2;
+            if (parts.size() == 6) {L2.reset(new Cache(parts[3], parts[4], parts[5], "L2"));}
+            if (tag_only) {
+                L1.keepTagsOnly();
+                if (L2) {L2->keepTagsOnly();}
+            }
+            if (classify_misses) {
+                L1.enableClassifier();
+                if (L2) {L2->enableClassifier();}
+            }
+            CacheHierarchy caches(&L1, L2.get(), policy);
+            caches.dram = dram.get();
+            vector<unique_ptr<ProgramSlot>> programs;
+            vector<ProgramSlot*> slots;
+            for (size_t i = 0; i < images.size(); ++i) {
+                programs.emplace_back(new ProgramSlot(i, physical.data()));
+                programs[i]->machine.load(images[i]);
+                programs[i]->shared = &caches;
+                programs[i]->ways = program_ways[i];
+                programs[i]->machine.attach(programs[i].get());
+                slots.push_back(programs[i].get());
+            }
+            status = run_programs(slots, slice, watchdog);
+            for (ProgramSlot *slot : slots) {simulated += slot->machine.steps;}
+            if (inclusion.size() > 0) {caches.printStats(cout);}
+            if (classify_misses) {
+                L1.classifier->print(L1.name, cout);
+                if (L2) {L2->classifier->print(L2->name, cout);}
+            }
+            //replay each program on its own over as many instructions as it got shared
+            for (size_t i = 0; i < programs.size(); ++i) {
+                ostream discard(nullptr);
+                vector<unsigned> alone_physical(MAX_PROGRAMS*MEM_SIZE, 0);
+                Cache alone_L1(parts[0], parts[1], parts[2], "L1", discard);
+                unique_ptr<Cache> alone_L2;
+                if (parts.size() == 6) {alone_L2.reset(new Cache(parts[3], parts[4], parts[5], "L2", discard));}
+                if (tag_only) {
+                    alone_L1.keepTagsOnly();
+                    if (alone_L2) {alone_L2->keepTagsOnly();}
+                }
+                CacheHierarchy alone_caches(&alone_L1, alone_L2.get(), policy);
+                ProgramSlot alone(i, alone_physical.data());
+                alone.machine.load(images[i]);
+                alone.shared = &alone_caches;
+                alone.machine.attach(&alone);
+                alone.machine.run(programs[i]->machine.steps);
+                cout << "Program " << i << ": " << (i == 0 ? string(filename) : co_run[i-1]) <<
+                    ", instructions " << programs[i]->machine.steps << endl;
+                alone.printCounts("alone", cout);
+                programs[i]->printCounts("shared", cout);
+            }
+            if (status != 0) {
+                for (auto &program : programs) {
+                    print_state(program->machine.pc, program->machine.regs, program->machine.memory, 128);
+                }
+            }
+        } else if (num_cores > 0) {
+            //every core starts at its entry pc, the last one given repeats for the rest
+            vector<Core> cores;
+            vector<unique_ptr<Cache>> private_L1s;
+            vector<Cache*> L1s;
+            for (int i = 0; i < num_cores; ++i) {
+                unsigned entry = entries.empty() ? 0 : entries[min((size_t)i, entries.size()-1)];
+                cores.push_back(Core(i, memory, entry));
+                private_L1s.emplace_back(new Cache(parts[0], parts[1], parts[2], "C" + to_string(i) + "L1"));
+                L1s.push_back(private_L1s.back().get());
+            }
+            unique_ptr<Cache> L2;
+            if (parts.size() == 6) {L2.reset(new Cache(parts[3], parts[4], parts[5], "L2"));}
+            vector<Cache*> all_caches = L1s;
+            if (L2) {all_caches.push_back(L2.get());}
+            if (tag_only) {
+                for (Cache* cache : all_caches) {cache->keepTagsOnly();}
+            }
+            if (classify_misses) {
+                for (Cache* cache : all_caches) {cache->enableClassifier();}
+            }
+            CoherenceBus bus(L1s, L2.get());
+            status = run_cores(cores, bus, memory, quantum, watchdog);
+            for (Core &core : cores) {simulated += core.machine.steps;}
+            bus.printStats(cores, 10);
+            if (classify_misses) {
+                for (Cache* cache : all_caches) {cache->classifier->print(cache->name, cout);}
+            }
+        } else if (parts.size() == 3) {
+            int L1size = parts[0];
+            int L1assoc = parts[1];
+            int L1blocksize = parts[2];
+            Cache L1(L1size, L1assoc, L1blocksize, "L1");
+            if (tag_only || replay_threads > 0) {L1.keepTagsOnly();}
+            if (replay_threads > 0) {
+                TraceRecorder recorder;
+                machine.attach(&recorder);
+                status = run_watched(machine, watchdog);
+                machine.attach(nullptr);
+                ParallelReplay replay(L1, replay_threads);
+                replay.run(recorder.trace, memory);
+                if (replay_summary) {replay.printSummary();}
+                else {replay.printLog(recorder.trace);}
+            }
+            else if (tag_only && compress_levels.empty() && !classify_misses && !dram && sample_every == 0 &&
+                    icache_config.empty() && !metrics) {
+                //nothing else watches the accesses, so the tags can live in a store fixed to the geometry
+                TagStoreHierarchy tags(L1, memory);
+                machine.attach(&tags);
+                status = run_watched(machine, watchdog);
+            }
+            else {
+                if (compress_levels.size() > 0) {L1.compress(compress_tags);}
+                if (classify_misses) {L1.enableClassifier();}
+                CacheHierarchy caches(&L1, nullptr);
+                caches.dram = dram.get();
+                caches.sample_every = max(sample_every, 1);
+                unique_ptr<Cache> L1I = make_icache(icache_config, icache, &L1, tag_only);
+                caches.I1 = L1I ? L1I.get() : icache_config.size() > 0 ? &L1 : nullptr;
+                caches.log_fetches = icache_log;
+                machine.attach(&caches);
+                if (metrics) {
+                    add_cache_metrics(*metrics, L1);
+                    add_hierarchy_metrics(*metrics, caches);
+                }
+                status = run_watched(machine, watchdog);
+                //the caches go out of scope here, so the final snapshot is written before they do
+                if (metrics && !metrics->write(true)) {cerr << "Can't write metrics to " << metrics_file << endl;}
+                if (caches.I1 != nullptr) {caches.printFetchStats(cout);}
+                if (sample_every > 0) {caches.printSampleStats(cout);}
+                if (classify_misses) {L1.classifier->print(L1.name, cout);}
+                if (compress_levels.size() > 0) {
+                    L1.printCompression(cout, memory);
+                    compare_uncompressed(images[0], machine.steps, caches, icache_config, icache, tag_only);
+                }
+            }
+        } else {
+            int L1size = parts[0];
+            int L1assoc = parts[1];
+            int L1blocksize = parts[2];
+            int L2size = parts[3];
+            int L2assoc = parts[4];
+            int L2blocksize = parts[5];
+
+            //Initialize the two caches
+            Cache L1(L1size, L1assoc, L1blocksize, "L1");
+            Cache L2(L2size, L2assoc, L2blocksize, "L2");
+            if (tag_only) {
+                L1.keepTagsOnly();
+                L2.keepTagsOnly();
+            }
+            if (compress_levels.find("L1") != string::npos) {L1.compress(compress_tags);}
+            if (compress_levels.find("L2") != string::npos) {L2.compress(compress_tags);}
+            if (classify_misses) {
+                L1.enableClassifier();
+                L2.enableClassifier();
+            }
+            CacheHierarchy caches(&L1, &L2, policy);
+            caches.dram = dram.get();
+            caches.sample_every = max(sample_every, 1);
+            unique_ptr<Cache> L1I = make_icache(icache_config, icache, &L1, tag_only);
+            caches.I1 = L1I ? L1I.get() : icache_config.size() > 0 ? &L1 : nullptr;
+            caches.log_fetches = icache_log;
+            machine.attach(&caches);
+            if (metrics) {
+                add_cache_metrics(*metrics, L1);
+                add_cache_metrics(*metrics, L2);
+                add_hierarchy_metrics(*metrics, caches);
+            }
+            status = run_watched(machine, watchdog);
+            if (metrics && !metrics->write(true)) {cerr << "Can't write metrics to " << metrics_file << endl;}
+            if (caches.I1 != nullptr) {caches.printFetchStats(cout);}
+            if (inclusion.size() > 0) {caches.printStats(cout);}
+            if (sample_every > 0) {caches.printSampleStats(cout);}
+            if (classify_misses) {
+                L1.classifier->print(L1.name, cout);
+                L2.classifier->print(L2.name, cout);
+            }
+            if (compress_levels.size() > 0) {
+                for (Cache* cache : {&L1, &L2}) {
+                    if (cache->tag_factor > 1) {cache->printCompression(cout, memory);}
+                }
+                compare_uncompressed(images[0], machine.steps, caches, icache_config, icache, tag_only);
+            }
+        }
+        if (num_cores == 0 && co_run.empty()) {simulated = machine.steps;}
+        if (perf) {perf->start("output");}
+        if (dram) {dram->print(cout);}
+        if (status != 0 && num_cores == 0 && co_run.empty()) {
+            print_state(machine.pc, machine.regs, machine.memory, 128);
+        }
+
+        if (cached) {cached->finish(status);}
+        if (perf) {perf->print(cerr, simulated);}
+    }
+
+    return status;
+}
+//ra0Eequ6ucie6Jei0koh6phishohm9
@@ -0,0 +1,88 @@
+/*
+E20 block compression library
+Sizes cache blocks under base-delta-immediate and zero-value encoding,
+for caches that store blocks compressed.
+E20compress.h
+*/
+
+#ifndef E20COMPRESS_H
+#define E20COMPRESS_H
+
+#include <cstdint>
+
+
+using namespace std;
+
+
+//encodings a block can be stored in, from most to least compact in general
+enum BlockEncoding {ENC_ZERO, ENC_REPEAT, ENC_BASE_DELTA, ENC_ZERO_VALUE, ENC_RAW};
+int const static NUM_ENCODINGS = 5;
+
+inline const char* encoding_name(int encoding) {
+    static const char* const names[NUM_ENCODINGS] = {"zero", "repeated", "base-delta", "zero-value", "uncompressed"};
+    return names[encoding];
+}
+
+//bytes of an uncompressed block of words 16-bit cells
+inline int raw_block_bytes(int words) {return 2*words;}
+
+//whether val is within a one-byte signed delta of base, at the 16-bit width of a cell
+inline bool fits_delta(uint16_t val, uint16_t base) {
+    int16_t delta = int16_t(uint16_t(val - base));
+    return delta >= -128 && delta <= 127;
+}
+
+/*
+    Finds the smallest encoding of a block, with the size in bytes it
+    takes in a compressed cache. The cells are 16 bits wide, so BDI has
+    one useful form here: a 2-byte base with 1-byte deltas. The base is
+    the first cell; when some cell is too far from it, cells may take
+    their delta from an implicit zero base instead, chosen by a mask bit
+    per cell, and the base is the first cell that is not near zero.
+    Zero-value encoding keeps a mask bit per cell and only the cells that
+    are not zero. An all-zero block is 1 byte and a repeated value 2.
+
+    @param block The cells of the block, of which the low 16 bits are cached
+    @param words Cells in the block
+    @param encoding Set to the encoding chosen, if not null
+
+    @return The block's size in bytes under that encoding
+*/
+inline int compressed_block_bytes(const unsigned block[], int words, int *encoding = nullptr) {
+    bool zeros = true, repeated = true, deltas = true, one_base = true;
+    int nonzero = 0;
+    bool have_base = false;
+    uint16_t base = 0;
+    uint16_t first = block[0];
+    for (int i = 0; i < words; ++i) {
+        uint16_t val = block[i];
+        if (val != 0) {
+            zeros = false;
+            nonzero++;
+        }
+        if (val != first) {repeated = false;}
+        if (!fits_delta(val, first)) {one_base = false;}
+        if (fits_delta(val, 0)) {continue;}
+        if (!have_base) {
+            have_base = true;
+            base = val;
+        }
+        else if (!fits_delta(val, base)) {deltas = false;}
+    }
+    int mask = (words + 7)/8;
+    int best = zeros ? ENC_ZERO : repeated ? ENC_REPEAT : ENC_RAW;
+    int bytes = zeros ? 1 : repeated ? 2 : raw_block_bytes(words);
+    int delta_bytes = one_base ? 2 + words : 2 + words + mask;
+    if ((deltas || one_base) && delta_bytes < bytes) {
+        best = ENC_BASE_DELTA;
+        bytes = delta_bytes;
+    }
+    if (mask + 2*nonzero < bytes) {
+        best = ENC_ZERO_VALUE;
+        bytes = mask + 2*nonzero;
+    }
+    if (encoding != nullptr) {*encoding = best;}
+    return bytes;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+E20 DRAM library
+A timing model of the main memory below the last cache level.
+E20dram.h
+*/
+
+#ifndef E20DRAM_H
+#define E20DRAM_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+
+using namespace std;
+
+
+/*
+    Main memory as banks of DRAM rows, each bank with one row buffer.
+    Consecutive DRAM rows are spread over the banks, so a streaming access
+    pattern moves from bank to bank before it comes back to one.
+
+    Memory contents still live in the flat memory array; the model only
+    counts the cycles each transfer would take:
+        row hit       the row is already open: tCAS
+        row empty     no row is open: tRCD + tCAS
+        row conflict  another row is open: tRP + tRCD + tCAS
+    followed by one cycle per further cell of a burst. With the closed
+    page policy every row is precharged right after its access, off the
+    critical path, so every access finds its bank empty.
+*/
+class DramModel {
+    public:
+        DramModel(int Banks, int RowSize, bool OpenPage, int TRCD, int TCAS, int TRP) :
+            banks(Banks), row_size(RowSize), open_page(OpenPage), tRCD(TRCD), tCAS(TCAS), tRP(TRP),
+            open_rows(Banks, -1), bank_accesses(Banks, 0) {}
+
+        int banks;
+        int row_size;
+        bool open_page;
+        int tRCD;
+        int tCAS;
+        int tRP;
+
+        unsigned long long reads = 0;
+        unsigned long long writes = 0;
+        unsigned long long row_hits = 0;
+        unsigned long long row_empty = 0;
+        unsigned long long row_conflicts = 0;
+        unsigned long long cycles = 0;
+
+        /*
+            Builds a model from a config of the form
+            banks,rowsize,open|closed,tRCD,tCAS,tRP
+
+            @return null if the config is invalid
+        */
+        static DramModel* parse(const string &config) {
+            vector<string> parts;
+            stringstream ss(config);
+            string item;
+            while (getline(ss, item, ',')) {parts.push_back(item);}
+            if (parts.size() != 6 || (parts[2] != "open" && parts[2] != "closed")) {
+                return nullptr;
+            }
+            int vals[6];
+            for (int i : {0, 1, 3, 4, 5}) {
+                vals[i] = atoi(parts[i].c_str());
+                if (vals[i] <= 0) {return nullptr;}
+            }
+            return new DramModel(vals[0], vals[1], parts[2] == "open", vals[3], vals[4], vals[5]);
+        }
+
+        //forget the open rows and counters, for another run
+        void reset() {
+            open_rows.assign(banks, -1);
+            bank_accesses.assign(banks, 0);
+            reads = writes = row_hits = row_empty = row_conflicts = cycles = 0;
+        }
+
+        /*
+            Transfer count cells starting at addr.
+
+            @return The cycles the transfer takes
+        */
+        unsigned access(int addr, int count, bool write) {
+            if (write) {writes++;}
+            else {reads++;}
+            unsigned latency = 0;
+            //a burst that crosses a DRAM row costs a second activation
+            int end = addr + count;
+            while (addr < end) {
+                int dram_row = addr / row_size;
+                int chunk = min(end, (dram_row + 1)*row_size) - addr;
+                latency += open(dram_row) + chunk - 1;
+                addr += chunk;
+            }
+            cycles += latency;
+            return latency;
+        }
+
+        //print the configuration, row-buffer outcomes and average latency
+        void print(ostream &out) {
+            unsigned long long accesses = reads + writes;
+            unsigned long long activations = row_hits + row_empty + row_conflicts;
+            out << "DRAM banks " << banks << ", row " << row_size << " cells, " << (open_page ? "open" : "closed") <<
+                " page, tRCD " << tRCD << ", tCAS " << tCAS << ", tRP " << tRP << endl;
+            out << "DRAM accesses " << accesses << " (reads " << reads << ", writes " << writes <<
+                "), row hits " << row_hits << ", empty " << row_empty << ", conflicts " << row_conflicts << endl;
+            out << fixed << setprecision(2) <<
+                "Row-buffer hit rate: " << (activations ? 100.0*row_hits/activations : 0.0) << "%" <<
+                ", average memory latency: " << (accesses ? (double)cycles/accesses : 0.0) << " cycles" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+            for (int bank = 0; bank < banks; ++bank) {
+                out << "\tbank:" << setw(3) << bank << "\taccesses:" << setw(7) << bank_accesses[bank] << endl;
+            }
+        }
+
+    private:
+        //row open in each bank, -1 when the bank is precharged
+        vector<int> open_rows;
+        vector<unsigned long long> bank_accesses;
+
+        //bring dram_row into its bank's row buffer, returns the cycles until the first cell
+        unsigned open(int dram_row) {
+            int bank = dram_row % banks;
+            int row = dram_row / banks;
+            bank_accesses[bank]++;
+            unsigned latency;
+            if (open_rows[bank] == row) {
+                row_hits++;
+                latency = tCAS;
+            }
+            else if (open_rows[bank] == -1) {
+                row_empty++;
+                latency = tRCD + tCAS;
+            }
+            else {
+                row_conflicts++;
+                latency = tRP + tRCD + tCAS;
+            }
+            open_rows[bank] = open_page ? row : -1;
+            return latency;
+        }
+};
+
+#endif
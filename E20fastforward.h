@@ -0,0 +1,337 @@
+/*
+E20 loop fast-forward
+Detects loops whose iterations change the machine state by a fixed
+amount and jumps over many iterations at once.
+E20fastforward.h
+*/
+
+#ifndef E20FASTFORWARD_H
+#define E20FASTFORWARD_H
+
+#include <cstdint>
+#include <climits>
+#include <vector>
+#include <algorithm>
+
+#include "E20machine.h"
+
+
+using namespace std;
+
+
+/*
+    Watches the back-edges of a run. Whenever the machine comes back to the
+    head of a loop it records the pcs of the next iteration, and on the
+    following return to the head tries to prove that the iteration is in a
+    steady state:
+
+        - every register either changes by the same amount each iteration
+          (the amount seen in the recorded iteration) or is rewritten by the
+          iteration before it is read
+        - every value feeding a store, a branch or a jr is affine in the
+          iteration number, so control flow and store addresses are known
+          in closed form for as many iterations as no branch outcome
+          changes, no add/sub/addi wraps and no store hits the loop's code
+
+    The proof evaluates the next iteration symbolically from the current
+    registers, with each value an offset plus a per-iteration slope, or
+    opaque for values that come from memory. When it holds for m
+    iterations, registers are advanced by m times their slope and the
+    stores of those iterations are written directly. If some register is
+    opaque, one iteration fewer is skipped so that the interpreter
+    recomputes it before anything can read it or the run can stop.
+
+    Anything outside the pattern (an opaque value reaching a store, branch
+    or jr, a path that does not repeat, a halt inside the loop) makes the
+    attempt fail and the loop keeps running instruction by instruction.
+*/
+class LoopFastForward {
+    public:
+        //loops jumped over, and the iterations and instructions that skipped
+        unsigned long long skips = 0;
+        unsigned long long iterations = 0;
+        unsigned long long instructions = 0;
+        //the pcs of the current iteration are being recorded
+        bool recording = false;
+
+        //called with pc before each instruction while recording
+        void record(unsigned pc) {
+            path.push_back(pc);
+            if (path.size() > MAX_PATH) {
+                //too long to be worth it, wait for the next back-edge
+                recording = false;
+            }
+        }
+
+        /*
+            Called after each jump to pc at or behind the jumping instruction.
+
+            @param budget Instructions that may be skipped, so step limits land exactly
+
+            @return The number of instructions skipped
+        */
+        unsigned long long backEdge(E20Machine &machine, unsigned long long budget) {
+            if (recording && machine.pc != head) {
+                //a jump inside the iteration, such as a return from a call
+                return 0;
+            }
+            unsigned long long skipped = 0;
+            if (recording && !path.empty()) {
+                skipped = advance(machine, budget);
+                if (skipped == 0 && failures < 10) {failures++;}
+                if (skipped > 0) {failures = 0;}
+                wait = (1ULL << failures) - 1;
+            }
+            else if (wait > 0) {
+                wait--;
+                return 0;
+            }
+            //start recording the next iteration from here
+            head = machine.pc;
+            start.assign(machine.regs, machine.regs + NUM_REGS);
+            path.clear();
+            recording = true;
+            return skipped;
+        }
+
+    private:
+        size_t const static MAX_PATH = 256;
+        //iterations skipped at once, keeps every product of a slope and an iteration count in range
+        long long const static MAX_ITERATIONS = 1LL << 24;
+
+        //a register value in iteration j is v0 + j*slope, unless it is opaque
+        struct Sym {
+            bool opaque;
+            long long v0;
+            long long slope;
+        };
+
+        //a sw of the iteration, its address and value in closed form
+        struct Store {
+            long long addr0;
+            long long addr_slope;
+            Sym val;
+        };
+
+        unsigned head = 0;
+        vector<unsigned> start;
+        vector<unsigned> path;
+        //failed attempts in a row, and back-edges to let pass before the next one
+        int failures = 0;
+        unsigned long long wait = 0;
+
+        //iterations, from 0, for which v0 + j*slope stays in [lo, hi)
+        static long long keepInRange(long long v0, long long slope, long long lo, long long hi) {
+            if (v0 < lo || v0 >= hi) {return 0;}
+            if (slope > 0) {return (hi - 1 - v0)/slope + 1;}
+            if (slope < 0) {return (v0 - lo)/(-slope) + 1;}
+            return LLONG_MAX;
+        }
+
+        //iterations for which diff0 + j*slope stays zero, or nonzero, as it is now
+        static long long keepEqual(long long diff0, long long slope) {
+            if (slope == 0) {return LLONG_MAX;}
+            if (diff0 == 0) {return 1;}
+            if ((-diff0) % slope == 0 && (-diff0)/slope > 0) {return (-diff0)/slope;}
+            return LLONG_MAX;
+        }
+
+        //iterations for which diff0 + j*slope stays positive, or not, as it is now
+        static long long keepPositive(long long diff0, long long slope) {
+            if (diff0 > 0) {return slope >= 0 ? LLONG_MAX : (diff0 - 1)/(-slope) + 1;}
+            return slope <= 0 ? LLONG_MAX : (-diff0)/slope + 1;
+        }
+
+        //prove the recorded iteration repeats and jump over as many copies as possible
+        unsigned long long advance(E20Machine &machine, unsigned long long budget) {
+            unsigned *memory = machine.memory;
+            Sym regs[NUM_REGS];
+            bool written[NUM_REGS] = {};
+            bool read_first[NUM_REGS] = {};
+            long long slopes[NUM_REGS];
+            for (size_t reg = 0; reg < NUM_REGS; ++reg) {
+                slopes[reg] = (long long)machine.regs[reg] - (long long)start[reg];
+                regs[reg] = Sym{false, machine.regs[reg], slopes[reg]};
+            }
+            regs[0] = Sym{false, 0, 0};
+            vector<Store> stores;
+            long long m = MAX_ITERATIONS;
+            auto read = [&](int reg) {
+                if (!written[reg]) {read_first[reg] = true;}
+                return regs[reg];
+            };
+            auto write = [&](int reg, Sym val) {
+                if (reg == 0) {return;}
+                regs[reg] = val;
+                written[reg] = true;
+            };
+            const long long REG_RANGE = 1LL << 32;
+            for (size_t i = 0; i < path.size() && m > 0; ++i) {
+                unsigned pc = path[i];
+                unsigned expected = i + 1 < path.size() ? path[i+1] : head;
+                uint16_t instruction = memory[pc];
+                uint16_t op = (instruction & 0b1110000000000000) >> 13;
+                uint16_t regA = (instruction & 0b0001110000000000) >> 10;
+                uint16_t regB = (instruction & 0b0000001110000000) >> 7;
+                uint16_t ext_imm = sign_extend_imm7(instruction & 0b0000000001111111);
+                long long simm = (int16_t)ext_imm;
+                unsigned next = pc + 1;
+                if (op == 0) {
+                    uint16_t func = instruction & 0b0000000000001111;
+                    uint16_t regDst = (instruction & 0b0000000001110000) >> 4;
+                    Sym a = read(regA);
+                    if (func == 8) {
+                        //the return address must be the same every iteration
+                        if (a.opaque || a.slope != 0 || a.v0 == pc) {return 0;}
+                        next = a.v0;
+                    }
+                    else {
+                        Sym b = read(regB);
+                        Sym res = Sym{true, 0, 0};
+                        if (func > 4) {return 0;}
+                        if (!a.opaque && !b.opaque) {
+                            if (func == 0 || func == 1) {
+                                res = func == 0 ? Sym{false, a.v0 + b.v0, a.slope + b.slope} :
+                                    Sym{false, a.v0 - b.v0, a.slope - b.slope};
+                                m = min(m, keepInRange(res.v0, res.slope, 0, REG_RANGE));
+                            }
+                            else if (func == 4) {
+                                res = Sym{false, a.v0 < b.v0 ? 1 : 0, 0};
+                                m = min(m, keepPositive(b.v0 - a.v0, b.slope - a.slope));
+                            }
+                            else if (a.slope == 0 && b.slope == 0) {
+                                res = Sym{false, func == 2 ? (a.v0 | b.v0) : (a.v0 & b.v0), 0};
+                            }
+                        }
+                        write(regDst, res);
+                    }
+                }
+                else if (op == 2 || op == 3) {
+                    unsigned imm = instruction & 0b0001111111111111;
+                    if (imm == pc) {return 0;}
+                    if (op == 3) {write(7, Sym{false, pc + 1, 0});}
+                    next = imm;
+                }
+                else if (op == 1 || op == 7) {
+                    Sym a = read(regA);
+                    Sym res = Sym{true, 0, 0};
+                    if (!a.opaque && op == 1) {
+                        res = Sym{false, a.v0 + simm, a.slope};
+                        m = min(m, keepInRange(res.v0, res.slope, 0, 1LL << 16));
+                    }
+                    else if (!a.opaque) {
+                        res = Sym{false, a.v0 < ext_imm ? 1 : 0, 0};
+                        m = min(m, keepPositive(ext_imm - a.v0, -a.slope));
+                    }
+                    write(regB, res);
+                }
+                else if (op == 4) {
+                    //the loaded word is only known to the interpreter
+                    read(regA);
+                    write(regB, Sym{true, 0, 0});
+                }
+                else if (op == 5) {
+                    Sym a = read(regA);
+                    Sym b = read(regB);
+                    if (a.opaque || b.opaque) {return 0;}
+                    //the address wraps at MEM_SIZE, which must not happen while skipping
+                    long long raw = a.v0 + simm;
+                    long long base = (raw >= 0 ? raw : raw - (long long)MEM_SIZE + 1) / (long long)MEM_SIZE * (long long)MEM_SIZE;
+                    m = min(m, keepInRange(raw, a.slope, base, base + MEM_SIZE));
+                    stores.push_back(Store{raw - base, a.slope, b});
+                }
+                else if (op == 6) {
+                    Sym a = read(regA);
+                    Sym b = read(regB);
+                    if (a.opaque || b.opaque) {return 0;}
+                    m = min(m, keepEqual(a.v0 - b.v0, a.slope - b.slope));
+                    if (a.v0 == b.v0) {
+                        next = (pc + ext_imm + 0b1) % 128;
+                        if (next == pc) {return 0;}
+                    }
+                }
+                if ((next & 0b1111111111111) != expected) {return 0;}
+            }
+            //the state at the end of the iteration must be the state at its start plus one slope
+            bool opaque = false;
+            for (size_t reg = 1; reg < NUM_REGS; ++reg) {
+                if (regs[reg].opaque) {
+                    if (read_first[reg]) {return 0;}
+                    opaque = true;
+                }
+                else if (regs[reg].v0 != (long long)machine.regs[reg] + slopes[reg] || regs[reg].slope != slopes[reg]) {
+                    return 0;
+                }
+            }
+            //the skipped iterations must not overwrite the loop
+            for (const Store &store : stores) {
+                for (unsigned pc : path) {
+                    long long diff = (long long)pc - store.addr0;
+                    if (store.addr_slope == 0) {
+                        if (diff == 0) {return 0;}
+                    }
+                    else if (diff % store.addr_slope == 0 && diff/store.addr_slope >= 0) {
+                        m = min(m, diff/store.addr_slope);
+                    }
+                }
+            }
+            //with opaque registers, one whole iteration must run before the run can stop
+            long long k = min(m, (long long)min(budget / path.size(), (unsigned long long)MAX_ITERATIONS));
+            if (opaque) {k--;}
+            if (k < 2) {
+                return 0;
+            }
+            for (long long j = 0; j < k; ++j) {
+                for (const Store &store : stores) {
+                    size_t addr = store.addr0 + j*store.addr_slope;
+                    unsigned val = store.val.v0 + j*store.val.slope;
+                    memory[addr] = val;
+                }
+            }
+            for (size_t reg = 1; reg < NUM_REGS; ++reg) {
+                if (!regs[reg].opaque) {machine.regs[reg] = machine.regs[reg] + k*slopes[reg];}
+            }
+            unsigned long long skipped = k*path.size();
+            machine.steps += skipped;
+            skips++;
+            iterations += k;
+            instructions += skipped;
+            return skipped;
+        }
+};
+
+/*
+    Runs machine like run_watched, jumping over steady-state loop iterations.
+    The state at every point where the run can stop is exactly the state
+    step by step execution reaches. Stuck loops are not detected, as the
+    skipped iterations would move the back-edges the watchdog samples.
+
+    @param machine The machine to run, from its current state, with no caches attached
+    @param watchdog Step and time limits to enforce
+    @param loops Keeps the loop being recorded and counts what was skipped
+    @return 0 if the machine halted, otherwise EXIT_BUDGET
+*/
+inline int run_fast_forward(E20Machine &machine, Watchdog &watchdog, LoopFastForward &loops)
+{
+    int status = 0;
+    while (!machine.halted && status == 0) {
+        unsigned old_pc = machine.pc;
+        if (loops.recording) {loops.record(machine.pc);}
+        machine.step();
+        if (!machine.halted && machine.steps >= watchdog.next_check) {
+            status = watchdog.check(machine.steps);
+        }
+        //skip no further than the next check, so step limits stop at the same state
+        if (machine.pc <= old_pc && !machine.halted && status == 0 &&
+                loops.backEdge(machine, watchdog.next_check - machine.steps) > 0 &&
+                !machine.halted && machine.steps >= watchdog.next_check) {
+            status = watchdog.check(machine.steps);
+        }
+    }
+    if (status != 0) {
+        cerr << "Stopped at pc " << machine.pc << " after " << machine.steps << " instructions: " << watchdog.reason << endl;
+    }
+    return status;
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+E20 fixed-geometry cache library
+Tag arrays specialized at compile time for power of two geometries, with
+a runtime dispatcher that falls back to the general Cache for the rest.
+E20fixedcache.h
+*/
+
+#ifndef E20FIXEDCACHE_H
+#define E20FIXEDCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+//largest geometries that get a specialized tag array, as logs of two
+int const static FIXED_MAX_BLOCK_BITS = 3;
+int const static FIXED_MAX_ROW_BITS = 8;
+int const static FIXED_MAX_WAY_BITS = 3;
+
+//the tags and LRU order of a cache, for runs that only need hits and misses
+class TagStore {
+    public:
+        virtual ~TagStore() {}
+
+        //update the tags for an access to addr, returns whether it hit.
+        //Rows share nothing, so accesses to different rows may run on different threads
+        virtual bool access(uint16_t addr) = 0;
+
+        virtual int rowOf(uint16_t addr) = 0;
+
+        //whether this store is one of the compile-time specializations
+        virtual bool specialized() = 0;
+};
+
+//call f(0), f(1), ... f(N-1) with each index a constant, so the way loops unroll fully
+template <typename F, int... I>
+inline void unrolled(F f, integer_sequence<int, I...>) {(f(I), ...);}
+
+/*
+    Tags of a cache with 2^BlockBits words per block, 2^RowBits rows and Ways
+    ways, all known at compile time: the row and tag come from shifts and
+    masks, and every loop over the ways is unrolled. Each row keeps its ways
+    in LRU order, least recently used first, starting from way 0 like Cache,
+    so both pick the same victims.
+*/
+template <int BlockBits, int RowBits, int Ways>
+class FixedTags : public TagStore {
+    public:
+        FixedTags() {
+            for (int row = 0; row < ROWS; ++row) {
+                for (int way = 0; way < Ways; ++way) {
+                    keys[row][way] = 0;
+                    order[row][way] = way;
+                }
+            }
+        }
+
+        bool access(uint16_t addr) override {
+            int row = rowOf(addr);
+            //keys are tag + 1, so an empty way never matches
+            uint32_t key = (addr >> (BlockBits + RowBits)) + 1;
+            uint32_t *row_keys = keys[row];
+            int way = -1;
+            unrolled([&](int i) {if (row_keys[i] == key) {way = i;}}, make_integer_sequence<int, Ways>());
+            bool hit = way != -1;
+            if (!hit) {
+                way = order[row][0];
+                row_keys[way] = key;
+            }
+            toTail(order[row], way);
+            return hit;
+        }
+
+        int rowOf(uint16_t addr) override {return (addr >> BlockBits) & (ROWS - 1);}
+
+        bool specialized() override {return true;}
+
+    private:
+        static constexpr int ROWS = 1 << RowBits;
+        uint32_t keys[ROWS][Ways];
+        uint8_t order[ROWS][Ways];
+
+        //move way to the most recently used end of the row's order
+        static void toTail(uint8_t *row_order, int way) {
+            int pos = 0;
+            unrolled([&](int i) {if (row_order[i] == way) {pos = i;}}, make_integer_sequence<int, Ways>());
+            unrolled([&](int i) {if (i >= pos && i < Ways - 1) {row_order[i] = row_order[i + 1];}},
+                make_integer_sequence<int, Ways>());
+            row_order[Ways - 1] = way;
+        }
+};
+
+//the general path, for geometries without a specialization
+class CacheTags : public TagStore {
+    public:
+        CacheTags(Cache &c, unsigned Mem[]) : cache(c), mem(Mem) {}
+
+        bool access(uint16_t addr) override {return cache.access(addr, mem);}
+
+        int rowOf(uint16_t addr) override {return cache.rowOf(addr);}
+
+        bool specialized() override {return false;}
+
+    private:
+        Cache &cache;
+        unsigned *mem;
+};
+
+typedef TagStore* (*TagStoreFactory)();
+
+template <int BlockBits, int RowBits, int Ways>
+TagStore* make_fixed_tags() {return new FixedTags<BlockBits, RowBits, Ways>();}
+
+//table of factories indexed by [block bits][row bits][way bits], filled at compile time
+class FixedTagsTable {
+    public:
+        TagStoreFactory factories[FIXED_MAX_BLOCK_BITS + 1][FIXED_MAX_ROW_BITS + 1][FIXED_MAX_WAY_BITS + 1];
+
+        FixedTagsTable() {fillBlocks(make_integer_sequence<int, FIXED_MAX_BLOCK_BITS + 1>());}
+
+    private:
+        template <int... B>
+        void fillBlocks(integer_sequence<int, B...>) {
+            (fillRows<B>(make_integer_sequence<int, FIXED_MAX_ROW_BITS + 1>()), ...);
+        }
+
+        template <int B, int... R>
+        void fillRows(integer_sequence<int, R...>) {
+            (fillWays<B, R>(make_integer_sequence<int, FIXED_MAX_WAY_BITS + 1>()), ...);
+        }
+
+        template <int B, int R, int... W>
+        void fillWays(integer_sequence<int, W...>) {
+            ((factories[B][R][W] = &make_fixed_tags<B, R, 1 << W>), ...);
+        }
+};
+
+/*
+    Builds the tag store for a cache's geometry: a FixedTags instance when
+    its block size, row count and associativity are powers of two within
+    the specialized range, otherwise one that runs through the cache itself.
+
+    @param cache The cache whose geometry to use, and the general path's tags
+    @param mem Memory the general path fills blocks from
+
+    @return A new tag store, owned by the caller
+*/
+inline TagStore* make_tag_store(Cache &cache, unsigned mem[]) {
+    static const FixedTagsTable table;
+    int way_bits = 0;
+    while ((1 << way_bits) < cache.assoc) {way_bits++;}
+    if (cache.pow2 && (1 << way_bits) == cache.assoc && cache.block_shift <= FIXED_MAX_BLOCK_BITS &&
+            cache.row_shift <= FIXED_MAX_ROW_BITS && way_bits <= FIXED_MAX_WAY_BITS) {
+        return table.factories[cache.block_shift][cache.row_shift][way_bits]();
+    }
+    return new CacheTags(cache, mem);
+}
+
+/*
+    Single cache that keeps only tags, simulated in the tag store for its
+    geometry and logged as Cache would. Stores write through and allocate
+    like Cache::setVal, and loads are served from memory.
+*/
+class TagStoreHierarchy : public MemoryHierarchy {
+    public:
+        TagStoreHierarchy(Cache &c, unsigned mem[]) : cache(c), tags(make_tag_store(c, mem)) {}
+
+        uint16_t load(uint16_t addr, unsigned mem[], unsigned pc) override {
+            bool hit = tags->access(addr);
+            cache.loads++;
+            cache.load_hits += hit;
+            print_log_entry(cache.name, hit ? "HIT" : "MISS", pc, addr, tags->rowOf(addr), *cache.out);
+            return mem[addr];
+        }
+
+        void store(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) override {
+            bool hit = tags->access(addr);
+            cache.stores++;
+            cache.store_hits += hit;
+            mem[addr] = val;
+            print_log_entry(cache.name, "SW", pc, addr, tags->rowOf(addr), *cache.out);
+        }
+
+    private:
+        Cache &cache;
+        unique_ptr<TagStore> tags;
+};
+
+#endif
@@ -0,0 +1,163 @@
+/*
+E20 host performance library
+Measures the host cycles, instructions, branch misses and last-level
+cache misses the simulator itself spends in each phase of a run.
+E20hostperf.h
+*/
+
+#ifndef E20HOSTPERF_H
+#define E20HOSTPERF_H
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <chrono>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+using namespace std;
+
+
+/*
+    Host hardware counters read around named phases with perf_event_open.
+    Each counter is opened on its own, for this process in user mode only,
+    so a host that lacks one (common in virtual machines) still reports the
+    others. Without any counters, for instance under a strict
+    perf_event_paranoid or on other systems, only wall-clock time is kept.
+*/
+class HostPerf {
+    public:
+        static int const COUNTERS = 4;
+
+        HostPerf() {
+            fill(fds, fds + COUNTERS, -1);
+#ifdef __linux__
+            static const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+            for (int i = 0; i < COUNTERS; ++i) {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[i];
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+                if (fds[i] == -1) {error = strerror(errno);}
+                else {counting = true;}
+            }
+#else
+            error = "perf_event_open needs Linux";
+#endif
+        }
+
+        ~HostPerf() {
+#ifdef __linux__
+            for (int fd : fds) {
+                if (fd != -1) {close(fd);}
+            }
+#endif
+        }
+
+        HostPerf(const HostPerf &) = delete;
+        HostPerf &operator=(const HostPerf &) = delete;
+
+        //whether any counter could be opened, and why one could not
+        bool counting = false;
+        string error;
+
+        //start measuring a phase, ending the current one if there is one
+        void start(const string &name) {
+            stop();
+            phases.push_back(Phase{name, 0, {0, 0, 0, 0}});
+            running = true;
+#ifdef __linux__
+            for (int fd : fds) {
+                if (fd != -1) {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+            start_time = chrono::steady_clock::now();
+        }
+
+        //end the current phase, if any
+        void stop() {
+            if (!running) {
+                return;
+            }
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+            running = false;
+            Phase &phase = phases.back();
+            phase.seconds = elapsed.count();
+#ifdef __linux__
+            for (int i = 0; i < COUNTERS; ++i) {
+                if (fds[i] == -1) {continue;}
+                ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                uint64_t count = 0;
+                if (read(fds[i], &count, sizeof(count)) == sizeof(count)) {phase.counts[i] = count;}
+            }
+#endif
+        }
+
+        /*
+            Print each phase's time and counters, and the simulation rate.
+
+            @param out Where to print
+            @param simulated E20 instructions executed, credited to the simulate phase
+        */
+        void print(ostream &out, unsigned long long simulated) {
+            stop();
+            out << "Host performance";
+            if (!counting) {out << " (counters unavailable: " << error << "; timing only)";}
+            out << ":" << endl;
+            out << "\tphase     " << setw(11) << "seconds";
+            if (counting) {
+                out << setw(15) << "cycles" << setw(15) << "instructions" << setw(15) << "branch misses" <<
+                    setw(15) << "LLC misses";
+            }
+            out << endl;
+            double simulate_seconds = 0;
+            for (const Phase &phase : phases) {
+                out << "\t" << left << setw(10) << phase.name << right << fixed << setprecision(6) <<
+                    setw(11) << phase.seconds;
+                out.unsetf(ios::floatfield);
+                for (int i = 0; counting && i < COUNTERS; ++i) {
+                    if (fds[i] == -1) {out << setw(15) << "-";}
+                    else {out << setw(15) << phase.counts[i];}
+                }
+                out << endl;
+                if (phase.name == "simulate") {simulate_seconds = phase.seconds;}
+            }
+            out << "Simulated instructions " << simulated << fixed << setprecision(2) << ", per host second " <<
+                (simulate_seconds > 0 ? simulated/simulate_seconds : 0.0) << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+    private:
+        struct Phase {
+            string name;
+            double seconds;
+            uint64_t counts[COUNTERS];
+        };
+
+        int fds[COUNTERS];
+        vector<Phase> phases;
+        bool running = false;
+        chrono::steady_clock::time_point start_time;
+};
+
+#endif
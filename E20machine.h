@@ -0,0 +1,792 @@
+/*
+E20 machine library
+The E20 interpreter and machine state shared by E20sim and E20cachesim,
+usable directly by programs that drive many runs in-process.
+E20machine.h
+*/
+
+#ifndef E20MACHINE_H
+#define E20MACHINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <regex>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+
+using namespace std;
+
+
+// Some helpful constant values that we'll be using.
+size_t const static NUM_REGS = 8;
+size_t const static MEM_SIZE = 1<<13;
+size_t const static REG_SIZE = 1<<16;
+
+
+/*
+    Parses the common form of a machine code line, "ram[ADDR] = 16'bBITS;",
+    without a regex. Anything else, including unusual but valid lines, is
+    left to the regex in load_machine_code.
+
+
+    @param line The line to parse
+    @param addr Set to ADDR
+    @param instr Set to the value of BITS
+    @return true if the line was parsed
+*/
+inline bool parse_machine_code_line(const string &line, size_t &addr, unsigned &instr)
+{
+    static const char prefix[] = "ram[";
+    static const char middle[] = "] = 16'b";
+    if (line.compare(0, 4, prefix) != 0)
+        return false;
+    size_t i = 4;
+    addr = 0;
+    size_t start = i;
+    while (i < line.size() && i - start < 9 && line[i] >= '0' && line[i] <= '9')
+        addr = addr*10 + (line[i++] - '0');
+    if (i == start || line.compare(i, 8, middle) != 0)
+        return false;
+    i += 8;
+    instr = 0;
+    start = i;
+    while (i < line.size() && i - start < 31 && (line[i] == '0' || line[i] == '1'))
+        instr = (instr << 1) | (line[i++] - '0');
+    return i != start && i < line.size() && line[i] == ';';
+}
+
+
+/*
+    Loads an E20 machine code file into the list
+    provided by mem. We assume that mem is
+    large enough to hold the values in the machine
+    code file.
+
+
+    @param f Open file to read from
+    @param mem Array represetnting memory into which to read program
+*/
+inline void load_machine_code(istream &f, unsigned mem[])
+{
+    static const regex machine_code_re("^ram\\[(\\d+)\\] = 16'b(\\d+);.*$");
+    size_t expectedaddr = 0;
+    string line;
+    while (getline(f, line))
+    {
+        size_t addr;
+        unsigned instr;
+        if (!parse_machine_code_line(line, addr, instr))
+        {
+            smatch sm;
+            if (!regex_match(line, sm, machine_code_re))
+            {
+                cerr << "Can't parse line: " << line << endl;
+                exit(1);
+            }
+            addr = stoi(sm[1], nullptr, 10);
+            instr = stoi(sm[2], nullptr, 2);
+        }
+        if (addr != expectedaddr)
+        {
+            cerr << "Memory addresses encountered out of sequence: " << addr << endl;
+            exit(1);
+        }
+        if (addr >= MEM_SIZE)
+        {
+            cerr << "Program too big for memory" << endl;
+            exit(1);
+        }
+        expectedaddr++;
+        mem[addr] = instr;
+    }
+}
+
+
+/*
+    Prints the current state of the simulator, including
+    the current program counter, the current register values,
+    and the first memquantity elements of memory.
+
+
+    @param pc The final value of the program counter
+    @param regs Final value of all registers
+    @param memory Final value of memory
+    @param memquantity How many words of memory to dump
+    @param out Where to print, cout unless a caller captures the output
+*/
+inline void print_state(unsigned pc, unsigned regs[], unsigned memory[], size_t memquantity, ostream &out = cout)
+{
+    out << setfill(' ');
+    out << "Final state:" << endl;
+    out << "\tpc=" << setw(5) << pc << endl;
+
+
+    for (size_t reg = 0; reg < NUM_REGS; reg++)
+        out << "\t$" << reg << "=" << setw(5) << regs[reg] << endl;
+
+
+    out << setfill('0');
+    bool cr = false;
+    for (size_t count = 0; count < memquantity; count++)
+    {
+        out << hex << setw(4) << memory[count] << " ";
+        cr = true;
+        if (count % 8 == 7)
+        {
+            out << endl;
+            cr = false;
+        }
+    }
+    if (cr)
+        out << endl;
+    out << dec << setfill(' ');
+}
+
+inline uint16_t fix_bit_length(uint16_t val) {
+    return val = val & 0b1111111111111111;
+}
+
+inline uint16_t fix_bit_length13(uint16_t val) {
+    return val = val & 0b1111111111111;
+}
+
+inline uint16_t convert_neg_imm(uint16_t val) {
+    val = (~val & 0b0000000001111111) + 0b1;
+    return val;
+}
+
+inline uint16_t sign_extend_imm7(uint16_t val) {
+    if (val & 0b1000000) {
+        return val |= 0b1111111111000000;
+    }
+    else {
+        return val;
+    }
+}
+
+/*
+    Where lw and sw go when a machine has a cache hierarchy attached.
+    Implementations must keep memory holding the architectural value of
+    every word, since instruction fetch reads it directly.
+*/
+class MemoryHierarchy {
+    public:
+        virtual ~MemoryHierarchy() {}
+
+        //return the word at addr, pc is the address of the lw
+        virtual uint16_t load(uint16_t addr, unsigned mem[], unsigned pc) = 0;
+
+        //write val to the word at addr, pc is the address of the sw
+        virtual void store(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) = 0;
+
+        //return the instruction at pc, for hierarchies that model instruction fetch
+        virtual uint16_t fetch(uint16_t pc, unsigned mem[]) {return mem[pc];}
+};
+
+// What an undo journal entry restores besides the pc
+uint8_t const static UNDO_NONE = 0;
+uint8_t const static UNDO_REG = 1;
+uint8_t const static UNDO_MEM = 2;
+
+/*
+    One entry of the undo journal: the pc before an instruction and the
+    register or memory word it overwrote, with its old value.
+*/
+struct UndoEntry {
+    uint16_t pc;
+    uint8_t kind;
+    uint8_t reg;
+    uint16_t addr;
+    unsigned old;
+};
+
+/*
+    Fills undo with the pc and the old value of whatever the instruction
+    at pc is about to overwrite.
+*/
+inline void record_undo(unsigned pc, unsigned regs[], unsigned memory[], UndoEntry &undo)
+{
+    uint16_t instruction = memory[pc];
+    uint16_t op = (instruction & 0b1110000000000000) >> 13;
+    undo.pc = pc;
+    undo.kind = UNDO_NONE;
+    undo.reg = 0;
+    undo.addr = 0;
+    undo.old = 0;
+    //add, sub, or, and, slt write regDst
+    if (op == 0 && (instruction & 0b0000000000001111) <= 4) {
+        undo.kind = UNDO_REG;
+        undo.reg = (instruction & 0b0000000001110000) >> 4;
+    }
+    //addi, lw, slti write regB
+    else if (op == 1 || op == 4 || op == 7) {
+        undo.kind = UNDO_REG;
+        undo.reg = (instruction & 0b0000001110000000) >> 7;
+    }
+    //jal writes $7
+    else if (op == 3) {
+        undo.kind = UNDO_REG;
+        undo.reg = 7;
+    }
+    //sw writes memory
+    else if (op == 5) {
+        uint16_t regA = (instruction & 0b0001110000000000) >> 10;
+        undo.kind = UNDO_MEM;
+        undo.addr = fix_bit_length13(sign_extend_imm7(instruction & 0b0000000001111111) + regs[regA]);
+        undo.old = memory[undo.addr];
+    }
+    if (undo.kind == UNDO_REG) {
+        undo.old = regs[undo.reg];
+    }
+}
+
+/*
+    Reverts the instruction recorded in undo.
+*/
+inline void apply_undo(unsigned &pc, unsigned regs[], unsigned memory[], const UndoEntry &undo)
+{
+    pc = undo.pc;
+    if (undo.kind == UNDO_REG) {
+        regs[undo.reg] = undo.old;
+    }
+    else if (undo.kind == UNDO_MEM) {
+        memory[undo.addr] = undo.old;
+    }
+}
+
+/*
+    Executes the instruction at pc, updating pc, regs and memory.
+
+
+    @param pc The program counter, moved to the next instruction
+    @param regs All registers
+    @param memory All of memory
+    @param undo If not null, filled with what the instruction overwrites, so it can be undone
+    @param caches If not null, the hierarchy lw and sw go through instead of memory
+    @return true if the instruction halts the machine by jumping to itself
+*/
+inline bool execute_instruction(unsigned &pc, unsigned regs[], unsigned memory[], UndoEntry *undo, MemoryHierarchy *caches)
+{
+    bool stop = false;
+    uint16_t op = 0b0000000000000000;
+    uint16_t imm = 0b0000000000000000;
+    uint16_t regA = 0b0000000000000000;
+    uint16_t regB = 0b0000000000000000;
+    uint16_t regDst = 0b0000000000000000;
+    if (undo != nullptr)
+    {
+        record_undo(pc, regs, memory, *undo);
+    }
+    //get the instruction bits and shift to the right 13 to obtain the opcode
+    uint16_t instruction = caches != nullptr ? caches->fetch(pc, memory) : memory[pc];
+    op = (instruction & 0b1110000000000000) >> 13;
+    //3 registers instructions
+    if (op == 0)
+    {
+        //get the immediate value, regA, regB, and regDst from the instruction
+        imm = instruction & 0b0000000000001111;
+        regA = (instruction & 0b0001110000000000) >> 10;
+        regB = (instruction & 0b0000001110000000) >> 7;
+        regDst = (instruction & 0b0000000001110000) >> 4;
+        //add
+        if (imm == 0)
+        {
+            //add two registers and store value into destination
+            regs[regDst] = regs[regA] + regs[regB];
+            pc += 1;
+        }
+        //sub
+        else if (imm == 1)
+        {
+            //subtract two registers and store value into destination
+            regs[regDst] = regs[regA] - regs[regB];
+            pc += 1;
+        }
+        //or
+        else if (imm == 2)
+        {
+            //or two registers and store value in desination
+            regs[regDst] = regs[regA] | regs[regB];
+            pc += 1;
+        }
+        //and
+        else if (imm == 3)
+        {
+            //and two registers and store value in destination
+            regs[regDst] = regs[regA] & regs[regB];
+            pc += 1;
+        }
+        //slt
+        else if (imm == 4)
+        {
+            //set regDst to 1 if regA < regB and 0 otherwise
+            if (regs[regA] < regs[regB])
+                {regs[regDst] = 1;}
+            else
+                {regs[regDst] = 0;}
+            pc += 1;
+        }
+        //jr
+        else if (imm == 8)
+        {
+            //if the immediate value is the same as the pc then it will result in a infinite loop so program is stopped if true
+            //and jumps to value in regA otherwise
+            if (regs[regA] == pc)
+            {
+                stop = true;
+            }
+            else
+            {
+                pc = regs[regA];
+            }
+        }
+    }
+    //0 register instructions
+    else if (op == 2 || op == 3)
+    {
+        //setup immmediate value from instructions
+        imm = instruction & 0b0001111111111111;
+        //j
+        if (op == 2)
+        {
+            // if immediate value is equal to pc it results in infinite loop so program is stopped and jumps to imm otherwise
+            if (imm == pc)
+            {
+                stop = true;
+            }
+            else
+            {
+                pc = imm;
+            }
+        }
+        //jal
+        else if (op == 3)
+        {
+            //sets value of register 7 to current memory address + 1 and jumps to immediate value
+            //if it does not result in an infinite loop
+            regs[7] = pc + 1;
+            if (imm == pc)
+            {
+                stop = true;
+            }
+            else
+            {
+                pc = imm;
+            }
+        }
+    }
+    //2 registers instructions
+    else
+    {
+        //setup imm, and register numbers from instruction
+        imm = instruction & 0b0000000001111111;
+        regA = (instruction & 0b0001110000000000) >> 10;
+        regB = (instruction & 0b0000001110000000) >> 7;
+        //sign extends immediate value for calculations
+        uint16_t ext_imm = sign_extend_imm7(imm);
+        //addi
+        if (op == 1)
+        {
+            //adds source reg and imm into destination
+            regs[regB] = regs[regA] + ext_imm;
+            regs[regB] = fix_bit_length(regs[regB]);
+            pc += 1;
+        }
+        //lw
+        else if (op == 4)
+        {
+            //stores the value at the memory location at immediate plus addr reg into destination
+            if (caches != nullptr)
+            {
+                regs[regB] = caches->load(fix_bit_length13(ext_imm + regs[regA]), memory, pc);
+            }
+            else
+            {
+                regs[regB] = memory[fix_bit_length13(ext_imm + regs[regA])];
+            }
+            pc += 1;
+        }
+        //sw 
+        else if (op == 5)
+        {
+            //stores value in source register into memory cell located from sum of immediate and value at addr register
+            if (caches != nullptr)
+            {
+                caches->store(fix_bit_length13(ext_imm + regs[regA]), regs[regB], memory, pc);
+            }
+            else
+            {
+                memory[fix_bit_length13(ext_imm + regs[regA])] = regs[regB];
+            }
+            pc += 1;
+        }
+        //jeq
+        else if (op == 6)
+        {
+            //checks if two registers are equal and jumps if true, increments by one otherwise
+            if (regs[regA] == regs[regB])
+            {
+                if ((pc + ext_imm + 0b1) % 128 == pc)
+                {
+                    stop = true;
+                }
+                else
+                {
+                    pc = (pc + ext_imm + 0b1)%128;
+                }
+            }
+            else {
+                pc += 1;
+            }
+            
+        }
+        //slti
+        else if (op == 7)
+        {
+            //checks if register value is less than immediate value and set destination to 1 or 0 accordingly
+            regs[regB] = (regs[regA] < ext_imm) ? 1:0;
+            pc += 1;
+        }
+    }
+    
+    //ensure pc is within range
+    pc &= 0b1111111111111;
+
+    //make sure register 0 is 0
+    regs[0] = 0b0000000000000000;
+    return stop;
+}
+
+//mnemonics retired instructions are counted under, indexed by opcode_class
+int const static NUM_OPCODE_CLASSES = 14;
+static const char* const OPCODE_NAMES[NUM_OPCODE_CLASSES] = {"add", "sub", "or", "and", "slt", "jr",
+    "addi", "j", "jal", "lw", "sw", "jeq", "slti", "undefined"};
+
+//index into OPCODE_NAMES of an instruction; three-register ones with an unknown function are undefined
+inline int opcode_class(uint16_t instruction)
+{
+    uint16_t op = (instruction & 0b1110000000000000) >> 13;
+    if (op != 0) {
+        return op + 5;
+    }
+    uint16_t func = instruction & 0b0000000000001111;
+    return func <= 4 ? func : func == 8 ? 5 : 13;
+}
+
+// Exit statuses of runs stopped by the watchdog, distinct from usage errors (1)
+int const static EXIT_BUDGET = 2;
+int const static EXIT_STUCK = 3;
+
+//splitmix64 finalizer, a cheap well mixed 64-bit hash
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+    Stops runs that never reach a halt. It enforces a step budget and a
+    wall-clock limit, and can prove a loop is stuck by finding an exact
+    repeat of the architectural state (pc, registers and memory) at a
+    loop back-edge. Back-edge states are compared against a snapshot
+    taken at power-of-two back-edge counts (Brent's cycle detection),
+    using an incrementally maintained hash of memory so a compare costs
+    a few operations unless the hashes match.
+*/
+class Watchdog {
+    public:
+        Watchdog(unsigned long long MaxSteps, double TimeLimit, bool DetectLoops) :
+        detect_loops(DetectLoops), max_steps(MaxSteps), time_limit(TimeLimit)
+        {
+            start_time = chrono::steady_clock::now();
+            next_check = max_steps;
+            if (time_limit > 0) {next_check = min(next_check, TIME_CHECK_INTERVAL);}
+        }
+
+        //step count at which check must be called, ULLONG_MAX when there are no limits
+        unsigned long long next_check;
+        bool detect_loops;
+
+        //hash all of memory once before the run starts
+        void start(unsigned mem[]) {
+            mem_hash = 0;
+            for (size_t addr = 0; addr < MEM_SIZE; ++addr) {mem_hash ^= word_hash(addr, mem[addr]);}
+        }
+
+        //also call tick every interval instructions, at exact multiples of it, until the run ends
+        void every(unsigned long long interval, function<void(unsigned long long)> Tick) {
+            tick = Tick;
+            tick_interval = interval;
+            next_tick = interval;
+            next_check = min(next_check, next_tick);
+        }
+
+        //called when steps reaches next_check, returns EXIT_BUDGET once a limit is hit
+        int check(unsigned long long steps) {
+            if (tick && steps >= next_tick) {
+                tick(steps);
+                next_tick = steps - steps % tick_interval + tick_interval;
+            }
+            if (steps >= max_steps) {
+                reason = "step limit reached";
+                return EXIT_BUDGET;
+            }
+            if (time_limit > 0) {
+                chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+                if (elapsed.count() >= time_limit) {
+                    reason = "time limit reached";
+                    return EXIT_BUDGET;
+                }
+            }
+            next_check = min(max_steps, steps + TIME_CHECK_INTERVAL);
+            if (tick) {next_check = min(next_check, next_tick);}
+            return 0;
+        }
+
+        //keep the memory hash current, called before a store overwrites old with val
+        void memWrite(size_t addr, unsigned old, unsigned val) {
+            mem_hash ^= word_hash(addr, old) ^ word_hash(addr, val);
+        }
+
+        //called after a jump to pc at or behind the jumping instruction, returns
+        //EXIT_STUCK when the machine is back in a state it has already been in
+        int backEdge(unsigned pc, unsigned regs[], unsigned mem[]) {
+            uint64_t hash = mem_hash ^ splitmix64(pc);
+            for (size_t reg = 0; reg < NUM_REGS; ++reg) {hash ^= splitmix64(((reg + 1) << 20) ^ regs[reg]);}
+            if (have_snapshot && hash == snap_hash && pc == snap_pc &&
+                equal(regs, regs + NUM_REGS, snap_regs.begin()) &&
+                equal(mem, mem + MEM_SIZE, snap_mem.begin())) {
+                reason = "infinite loop detected";
+                return EXIT_STUCK;
+            }
+            if (++edges == next_snapshot) {
+                have_snapshot = true;
+                snap_hash = hash;
+                snap_pc = pc;
+                snap_regs.assign(regs, regs + NUM_REGS);
+                snap_mem.assign(mem, mem + MEM_SIZE);
+                next_snapshot *= 2;
+            }
+            return 0;
+        }
+
+        //why the run was stopped
+        string reason;
+
+    private:
+        static constexpr unsigned long long TIME_CHECK_INTERVAL = 1<<16;
+        unsigned long long max_steps;
+        double time_limit;
+        chrono::steady_clock::time_point start_time;
+        uint64_t mem_hash = 0;
+        unsigned long long edges = 0;
+        unsigned long long next_snapshot = 1;
+        bool have_snapshot = false;
+        uint64_t snap_hash = 0;
+        unsigned snap_pc = 0;
+        vector<unsigned> snap_regs;
+        vector<unsigned> snap_mem;
+        function<void(unsigned long long)> tick;
+        unsigned long long tick_interval = 0;
+        unsigned long long next_tick = ULLONG_MAX;
+
+
+        static uint64_t word_hash(size_t addr, unsigned val) {return splitmix64((uint64_t(addr) << 32) | val);}
+};
+
+
+/*
+    An E20 machine that can be embedded in other programs. Memory,
+    registers and pc are plain public fields so callers can read and
+    poke them in place. By default the machine owns its memory; passing
+    a buffer of MEM_SIZE words makes it run over that buffer instead,
+    which is how the cores of the multi-core mode share memory.
+*/
+class E20Machine {
+    public:
+        E20Machine() : own_memory(MEM_SIZE, 0) {
+            memory = own_memory.data();
+            reset();
+        }
+
+        E20Machine(unsigned *Memory) : memory(Memory) {reset();}
+
+        //memory may point into own_memory, so machines move but do not copy
+        E20Machine(const E20Machine &) = delete;
+        E20Machine &operator=(const E20Machine &) = delete;
+        E20Machine(E20Machine &&) = default;
+        E20Machine &operator=(E20Machine &&) = default;
+
+        //the memory buffer, MEM_SIZE words
+        unsigned *memory;
+        unsigned regs[NUM_REGS];
+        unsigned pc;
+        bool halted;
+        //instructions executed since the last reset
+        unsigned long long steps;
+        //instructions retired by opcode_class, empty unless countOpcodes was called
+        vector<unsigned long long> op_counts;
+
+        //start counting retired instructions by opcode, which run does in a loop of its own
+        void countOpcodes() {op_counts.assign(NUM_OPCODE_CLASSES, 0);}
+
+        //parse a machine code file into memory and remember it as the image reset restores
+        void load(istream &f) {
+            fill(memory, memory + MEM_SIZE, 0);
+            load_machine_code(f, memory);
+            image.assign(memory, memory + MEM_SIZE);
+            clearState();
+        }
+
+        //use words as the memory image, shorter images are padded with zeros
+        void load(const vector<unsigned> &words) {
+            image.assign(MEM_SIZE, 0);
+            copy(words.begin(), words.begin() + min(words.size(), MEM_SIZE), image.begin());
+            reset();
+        }
+
+        //put memory back to the loaded image, if any, and clear pc and registers
+        void reset() {
+            if (!image.empty()) {
+                copy(image.begin(), image.end(), memory);
+            }
+            clearState();
+        }
+
+        //send lw and sw through caches, or straight to memory when null. Not owned
+        void attach(MemoryHierarchy *caches) {hierarchy = caches;}
+
+        MemoryHierarchy *attached() {return hierarchy;}
+
+        //execute one instruction, returns false once the machine has halted
+        bool step(UndoEntry *undo = nullptr) {
+            if (halted) {
+                return false;
+            }
+            if (!op_counts.empty()) {op_counts[opcode_class(memory[pc])]++;}
+            halted = execute_instruction(pc, regs, memory, undo, hierarchy);
+            steps++;
+            return !halted;
+        }
+
+        //execute until halted or max_steps instructions, returns the number executed
+        unsigned long long run(unsigned long long max_steps = ULLONG_MAX) {
+            unsigned long long start = steps;
+            if (!op_counts.empty()) {
+                while (!halted && steps - start < max_steps) {
+                    op_counts[opcode_class(memory[pc])]++;
+                    halted = execute_instruction(pc, regs, memory, nullptr, hierarchy);
+                    steps++;
+                }
+                return steps - start;
+            }
+            while (!halted && steps - start < max_steps) {
+                halted = execute_instruction(pc, regs, memory, nullptr, hierarchy);
+                steps++;
+            }
+            return steps - start;
+        }
+
+        /*
+            Decodes the instruction at pc if it is a lw or sw.
+
+            @param addr Set to the address it accesses
+            @param store Set to true for sw
+            @param reg Set to the register it loads into or stores from
+            @return true if the next instruction accesses memory
+        */
+        bool nextAccess(uint16_t &addr, bool &store, uint16_t &reg) {
+            uint16_t instruction = memory[pc];
+            uint16_t op = (instruction & 0b1110000000000000) >> 13;
+            if (halted || (op != 4 && op != 5)) {
+                return false;
+            }
+            uint16_t regA = (instruction & 0b0001110000000000) >> 10;
+            reg = (instruction & 0b0000001110000000) >> 7;
+            addr = fix_bit_length13(sign_extend_imm7(instruction & 0b0000000001111111) + regs[regA]);
+            store = (op == 5);
+            return true;
+        }
+
+        //retire the lw or sw at pc whose access was serviced elsewhere, val is the loaded word
+        void completeAccess(bool store, uint16_t reg, uint16_t val) {
+            if (!store) {
+                regs[reg] = val;
+            }
+            regs[0] = 0b0000000000000000;
+            if (!op_counts.empty()) {op_counts[opcode_class(memory[pc])]++;}
+            pc = (pc + 1) & 0b1111111111111;
+            steps++;
+        }
+
+    private:
+        vector<unsigned> own_memory;
+        vector<unsigned> image;
+        MemoryHierarchy *hierarchy = nullptr;
+
+        void clearState() {
+            fill(regs, regs + NUM_REGS, 0);
+            pc = 0;
+            halted = false;
+            steps = 0;
+        }
+};
+
+/*
+    Runs machine until it halts or the watchdog stops it.
+
+    @param machine The machine to run, from its current state
+    @param watchdog Limits to enforce, started on machine's memory if it detects loops
+    @return 0 if the machine halted, otherwise EXIT_BUDGET or EXIT_STUCK
+*/
+inline int run_watched(E20Machine &machine, Watchdog &watchdog)
+{
+    if (watchdog.next_check == ULLONG_MAX && !watchdog.detect_loops) {
+        machine.run();
+        return 0;
+    }
+    int status = 0;
+    if (!watchdog.detect_loops) {
+        //no back-edges to look at, so run straight to each check, at least one instruction at a time
+        while (!machine.halted && status == 0) {
+            machine.run(watchdog.next_check > machine.steps ? watchdog.next_check - machine.steps : 1);
+            if (!machine.halted && machine.steps >= watchdog.next_check) {
+                status = watchdog.check(machine.steps);
+            }
+        }
+    }
+    if (watchdog.detect_loops) {
+        watchdog.start(machine.memory);
+    }
+    while (!machine.halted && status == 0) {
+        unsigned old_pc = machine.pc;
+        UndoEntry undo;
+        machine.step(watchdog.detect_loops ? &undo : nullptr);
+        if (watchdog.detect_loops && undo.kind == UNDO_MEM) {
+            watchdog.memWrite(undo.addr, undo.old, machine.memory[undo.addr]);
+        }
+        //stop runaway programs once a limit is hit or the state provably repeats; a
+        //program that halts on its last allowed instruction finished within the limit
+        if (!machine.halted && machine.steps >= watchdog.next_check) {
+            status = watchdog.check(machine.steps);
+        }
+        if (watchdog.detect_loops && machine.pc <= old_pc && !machine.halted && status == 0) {
+            status = watchdog.backEdge(machine.pc, machine.regs, machine.memory);
+        }
+    }
+    if (status != 0) {
+        cerr << "Stopped at pc " << machine.pc << " after " << machine.steps << " instructions: " << watchdog.reason << endl;
+    }
+    return status;
+}
+
+#endif
@@ -0,0 +1,281 @@
+/*
+E20 metrics library
+Gathers the simulator's and the caches' counters into named metrics and
+writes them to a file as JSON lines or Prometheus text, at the end of a
+run and optionally every so many instructions during it.
+E20metrics.h
+*/
+
+#ifndef E20METRICS_H
+#define E20METRICS_H
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <chrono>
+
+#include "E20machine.h"
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+//file formats Metrics writes
+enum MetricsFormat {METRICS_JSON, METRICS_PROMETHEUS};
+
+//label names and values of one sample, in order
+typedef vector<pair<string, string>> MetricLabels;
+
+/*
+    A registry of metrics that are read from the counters they describe
+    only when a snapshot is written, so nothing is looked up or copied
+    while simulating. Collectors, registered once the objects they read
+    exist, add their current values with counter and gauge. The registry
+    also times the named phases of the run itself.
+
+    JSON snapshots are appended to the file one object per line, so
+    periodic ones form a time series. A Prometheus snapshot replaces the
+    file, written beside it and renamed into place so a scraper never
+    reads a partial one.
+*/
+class Metrics {
+    public:
+        typedef function<void(Metrics&)> Collector;
+
+        Metrics(const string &Path, MetricsFormat Format) : path(Path), format(Format) {
+            start_time = chrono::steady_clock::now();
+            ofstream f(path, ios::trunc);
+            ok = f.is_open();
+        }
+
+        //whether the file could be created
+        bool ok;
+
+        void addCollector(Collector collector) {collectors.push_back(collector);}
+
+        //start timing a phase, ending the current one if there is one
+        void phase(const string &name) {
+            stopPhase();
+            phases.push_back(make_pair(name, 0.0));
+            phase_start = chrono::steady_clock::now();
+            timing = true;
+        }
+
+        //seconds spent in the named phase so far, counting it if it is running
+        double phaseSeconds(const string &name) {
+            double seconds = 0;
+            for (size_t i = 0; i < phases.size(); ++i) {
+                if (phases[i].first != name) {continue;}
+                seconds += phases[i].second;
+                if (timing && i == phases.size() - 1) {
+                    seconds += chrono::duration<double>(chrono::steady_clock::now() - phase_start).count();
+                }
+            }
+            return seconds;
+        }
+
+        //add a sample to the snapshot being collected; counters only ever grow
+        void counter(const string &name, const string &help, double value, const MetricLabels &labels = {}) {
+            samples.push_back(Sample{name, help, "counter", labels, value});
+        }
+
+        void gauge(const string &name, const string &help, double value, const MetricLabels &labels = {}) {
+            samples.push_back(Sample{name, help, "gauge", labels, value});
+        }
+
+        /*
+            Collect a snapshot and write it to the file.
+
+            @param final Whether this is the snapshot at the end of the run
+            @return false if the file could not be written
+        */
+        bool write(bool final) {
+            samples.clear();
+            for (Collector &collector : collectors) {collector(*this);}
+            for (const pair<string, double> &p : phases) {
+                gauge("e20_phase_seconds", "Host seconds spent in each phase of the run", phaseSeconds(p.first),
+                    {{"phase", p.first}});
+            }
+            if (format == METRICS_JSON) {
+                ofstream f(path, ios::app);
+                writeJson(f, final);
+                return bool(f);
+            }
+            string temp = path + ".tmp";
+            {
+                ofstream f(temp, ios::trunc);
+                writePrometheus(f);
+                if (!f) {
+                    return false;
+                }
+            }
+            return rename(temp.c_str(), path.c_str()) == 0;
+        }
+
+        //one JSON object holding the collected samples, on one line
+        void writeJson(ostream &out, bool final) {
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+            out << "{\"final\":" << (final ? "true" : "false") << ",\"elapsed_seconds\":" << number(elapsed) <<
+                ",\"metrics\":[";
+            for (size_t i = 0; i < samples.size(); ++i) {
+                const Sample &sample = samples[i];
+                out << (i > 0 ? "," : "") << "{\"name\":" << quoted(sample.name, false) << ",\"type\":\"" <<
+                    sample.type << "\",\"labels\":{";
+                for (size_t j = 0; j < sample.labels.size(); ++j) {
+                    out << (j > 0 ? "," : "") << quoted(sample.labels[j].first, false) << ":" <<
+                        quoted(sample.labels[j].second, false);
+                }
+                out << "},\"value\":" << number(sample.value) << "}";
+            }
+            out << "]}" << endl;
+        }
+
+        //the collected samples in the Prometheus text format, one HELP and TYPE per name
+        void writePrometheus(ostream &out) {
+            vector<bool> written(samples.size(), false);
+            for (size_t i = 0; i < samples.size(); ++i) {
+                if (written[i]) {continue;}
+                out << "# HELP " << samples[i].name << " " << escaped(samples[i].help, true) << "\n";
+                out << "# TYPE " << samples[i].name << " " << samples[i].type << "\n";
+                for (size_t j = i; j < samples.size(); ++j) {
+                    if (samples[j].name != samples[i].name) {continue;}
+                    written[j] = true;
+                    out << samples[j].name;
+                    for (size_t k = 0; k < samples[j].labels.size(); ++k) {
+                        out << (k == 0 ? "{" : ",") << samples[j].labels[k].first << "=" <<
+                            quoted(samples[j].labels[k].second, true);
+                    }
+                    out << (samples[j].labels.empty() ? "" : "}") << " " << number(samples[j].value) << "\n";
+                }
+            }
+            out.flush();
+        }
+
+    private:
+        struct Sample {
+            string name;
+            string help;
+            const char* type;
+            MetricLabels labels;
+            double value;
+        };
+
+        string path;
+        MetricsFormat format;
+        vector<Collector> collectors;
+        vector<Sample> samples;
+        chrono::steady_clock::time_point start_time;
+        vector<pair<string, double>> phases;
+        chrono::steady_clock::time_point phase_start;
+        bool timing = false;
+
+        void stopPhase() {
+            if (!timing) {
+                return;
+            }
+            phases.back().second += chrono::duration<double>(chrono::steady_clock::now() - phase_start).count();
+            timing = false;
+        }
+
+        //whole numbers print exactly, as counts should, the rest with 9 significant digits
+        static string number(double value) {
+            ostringstream ss;
+            if (value == floor(value) && fabs(value) < 1e18) {ss << (long long)value;}
+            else {ss << setprecision(9) << value;}
+            return ss.str();
+        }
+
+        //escape backslashes, quotes and newlines, and for JSON the other control characters
+        static string escaped(const string &text, bool prometheus) {
+            string out;
+            for (char c : text) {
+                if (c == '\\') {out += "\\\\";}
+                else if (c == '"') {out += "\\\"";}
+                else if (c == '\n') {out += "\\n";}
+                else if ((unsigned char)c < 0x20 && !prometheus) {
+                    char code[8];
+                    snprintf(code, sizeof(code), "\\u%04x", c);
+                    out += code;
+                }
+                else {out += c;}
+            }
+            return out;
+        }
+
+        static string quoted(const string &text, bool prometheus) {return "\"" + escaped(text, prometheus) + "\"";}
+};
+
+//instructions retired in all and by opcode, and the simulation rate
+inline void add_machine_metrics(Metrics &metrics, E20Machine &machine)
+{
+    metrics.addCollector([&machine](Metrics &m) {
+        m.counter("e20_instructions_total", "Instructions retired", machine.steps);
+        for (size_t i = 0; i < machine.op_counts.size(); ++i) {
+            m.counter("e20_instructions_retired_total", "Instructions retired by opcode", machine.op_counts[i],
+                {{"opcode", OPCODE_NAMES[i]}});
+        }
+        m.gauge("e20_halted", "Whether the machine has halted", machine.halted ? 1 : 0);
+        double seconds = m.phaseSeconds("simulate");
+        m.gauge("e20_instructions_per_second", "Instructions retired per host second of simulation",
+            seconds > 0 ? machine.steps/seconds : 0);
+    });
+}
+
+//loads and stores a cache saw, their hits and misses, its evictions, and how well it compresses
+inline void add_cache_metrics(Metrics &metrics, Cache &cache)
+{
+    metrics.addCollector([&cache](Metrics &m) {
+        for (int store = 0; store < 2; ++store) {
+            MetricLabels labels = {{"cache", cache.name}, {"kind", store ? "store" : "load"}};
+            unsigned long long accesses = store ? cache.stores : cache.loads;
+            unsigned long long hits = store ? cache.store_hits : cache.load_hits;
+            m.counter("e20_cache_accesses_total", "Data accesses seen by each cache level", accesses, labels);
+            m.counter("e20_cache_hits_total", "Data accesses that hit in each cache level", hits, labels);
+            m.counter("e20_cache_misses_total", "Data accesses that missed in each cache level", accesses - hits, labels);
+        }
+        m.counter("e20_cache_evictions_total", "Valid blocks replaced by fills", cache.evictions(), {{"cache", cache.name}});
+        if (cache.tag_factor > 1) {
+            m.gauge("e20_cache_compression_ratio", "Bytes of the blocks filled into a compressed cache before and after compression",
+                cache.packed_bytes ? double(cache.raw_bytes)/cache.packed_bytes : 0, {{"cache", cache.name}});
+            m.counter("e20_cache_space_evictions_total", "Blocks a compressed cache evicted to make space",
+                cache.space_evictions, {{"cache", cache.name}});
+        }
+    });
+}
+
+//where accesses and fetches were served, and the inclusion policy's block moves
+inline void add_hierarchy_metrics(Metrics &metrics, CacheHierarchy &caches)
+{
+    metrics.addCollector([&caches](Metrics &m) {
+        const string help = "Data accesses by the level that served them";
+        m.counter("e20_accesses_served_total", help, caches.L1_hits, {{"level", caches.L1->name}});
+        if (caches.L2 != nullptr) {m.counter("e20_accesses_served_total", help, caches.L2_hits, {{"level", caches.L2->name}});}
+        m.counter("e20_accesses_served_total", help, caches.memory_fetches, {{"level", "memory"}});
+        if (caches.sample_every > 1) {
+            m.counter("e20_accesses_unsampled_total", "Data accesses to rows left out by set sampling", caches.skipped);
+        }
+        if (caches.L2 != nullptr && caches.policy != NON_INCLUSIVE) {
+            m.counter("e20_back_invalidations_total", "L1 blocks dropped because the L2 evicted them",
+                caches.back_invalidations);
+            m.counter("e20_promotions_total", "Blocks moved from the L2 up into the L1", caches.promotions);
+            m.counter("e20_victims_total", "L1 victims moved down into the L2", caches.victims);
+        }
+        if (caches.I1 != nullptr) {
+            const string fetch_help = "Instruction fetches by the level that served them";
+            m.counter("e20_fetches_served_total", fetch_help, caches.fetch_I1_hits, {{"level", caches.I1->name}});
+            if (caches.L2 != nullptr) {
+                m.counter("e20_fetches_served_total", fetch_help, caches.fetch_L2_hits, {{"level", caches.L2->name}});
+            }
+            m.counter("e20_fetches_served_total", fetch_help, caches.fetch_memory, {{"level", "memory"}});
+        }
+    });
+}
+
+#endif
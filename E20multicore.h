@@ -0,0 +1,352 @@
+/*
+E20 multi-core library
+Cores with private L1s kept coherent with MESI, run on host threads when
+their quanta are long enough to gain from it.
+E20multicore.h
+*/
+
+#ifndef E20MULTICORE_H
+#define E20MULTICORE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "E20machine.h"
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+//MESI states kept per line in the private L1 of each core
+enum MesiState {MESI_I = 0, MESI_S = 1, MESI_E = 2, MESI_M = 3};
+
+//one E20 core of the multi-core mode, a machine running over the shared memory
+class Core {
+    public:
+        Core(int Id, unsigned memory[], unsigned entry) : id(Id), machine(memory) {
+            machine.pc = entry;
+        }
+
+        int id;
+        E20Machine machine;
+        //memory access the core is waiting on at the end of its quantum
+        bool pending = false;
+        bool pending_store = false;
+        uint16_t pending_addr = 0;
+        uint16_t pending_reg = 0;
+        unsigned long long loads = 0;
+        unsigned long long stores = 0;
+
+        //execute up to quantum instructions. The quantum ends early in front of the
+        //first lw or sw, which is left pending so the bus can service it in core order.
+        //The access cannot be put off any longer, as a load's value feeds what follows,
+        //so the quantum only bounds runs of instructions that do not touch memory
+        void runQuantum(int quantum) {
+            for (int n = 0; n < quantum && !machine.halted && !pending; ++n) {
+                if (machine.nextAccess(pending_addr, pending_store, pending_reg)) {
+                    pending = true;
+                }
+                else {
+                    machine.step();
+                }
+            }
+        }
+
+        //complete the pending access once the bus has serviced it
+        void retire(uint16_t val) {
+            machine.completeAccess(pending_store, pending_reg, val);
+            if (pending_store) {stores++;}
+            else {loads++;}
+            pending = false;
+        }
+};
+
+//most cores a run may have, each of which gets a host thread
+int const static MAX_CORES = 64;
+
+/*
+    Reusable barrier for the core threads and the bus. A waiter spins for a
+    while first, as a round of short quanta is over in microseconds, and
+    only then sleeps, so threads parked through a long stretch of inline
+    rounds do not take the host cores from the one doing the work.
+*/
+class QuantumBarrier {
+    public:
+        QuantumBarrier(int Count) : count(Count) {}
+
+        void wait() {
+            unsigned long long gen = generation.load(memory_order_acquire);
+            if (waiting.fetch_add(1, memory_order_acq_rel) + 1 == count) {
+                waiting.store(0, memory_order_relaxed);
+                //the lock keeps the release from slipping between a sleeper's check and its wait
+                lock_guard<mutex> lock(m);
+                generation.store(gen + 1, memory_order_release);
+                cv.notify_all();
+                return;
+            }
+            for (int spins = 0; spins < SPIN_LIMIT; ++spins) {
+                if (generation.load(memory_order_acquire) != gen) {return;}
+            }
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] {return generation.load(memory_order_acquire) != gen;});
+        }
+
+    private:
+        static const int SPIN_LIMIT = 1 << 14;
+        mutex m;
+        condition_variable cv;
+        int count;
+        atomic<int> waiting{0};
+        atomic<unsigned long long> generation{0};
+};
+
+//snooping bus keeping the private L1s coherent with MESI over an optional shared L2.
+//L1s behave as write-back caches for traffic accounting, while memory is still updated
+//on every store so that the architectural state matches the single core simulator
+class CoherenceBus {
+    public:
+        CoherenceBus(vector<Cache*> L1s, Cache* L2) : caches(L1s), shared(L2) {
+            hits.resize(caches.size(), 0);
+            misses.resize(caches.size(), 0);
+        }
+
+        unsigned long long bus_reads = 0;
+        unsigned long long bus_read_excl = 0;
+        unsigned long long bus_upgrades = 0;
+        unsigned long long flushes = 0;
+        unsigned long long writebacks = 0;
+        unsigned long long invalidations = 0;
+        unsigned long long false_sharing = 0;
+        vector<unsigned long long> hits;
+        vector<unsigned long long> misses;
+        //invalidations per block id, split into all and false-sharing ones
+        map<int, unsigned long long> block_invalidations;
+        map<int, unsigned long long> block_false_sharing;
+
+        uint16_t load(int core, uint16_t addr, unsigned mem[], unsigned pc) {
+            Cache* L1 = caches[core];
+            int row = L1->rowOf(addr);
+            int index = addr % L1->blocksize;
+            int assoc = L1->rows[row]->inTags(L1->tagOf(addr));
+            L1->classify(addr/L1->blocksize, row, assoc != -1, false);
+            if (assoc != -1) {
+                hits[core]++;
+                L1->rows[row]->pushToTail(assoc);
+                L1->rows[row]->touch(assoc, index);
+                print_log_entry(L1->name, "HIT", pc, addr, row, *L1->out);
+                return L1->readVal(row, assoc, addr, mem);
+            }
+            //BusRd: owners flush and every other copy drops to shared
+            misses[core]++;
+            bus_reads++;
+            bool shared_copy = false;
+            for (size_t other = 0; other < caches.size(); ++other) {
+                if ((int)other == core) {continue;}
+                Cache* C = caches[other];
+                int orow = C->rowOf(addr);
+                int oassoc = C->rows[orow]->inTags(C->tagOf(addr));
+                if (oassoc == -1) {continue;}
+                shared_copy = true;
+                if (C->rows[orow]->getState(oassoc) == MESI_M) {
+                    flushes++;
+                    if (shared != nullptr) {shared->writeBack(addr, mem, pc);}
+                }
+                C->rows[orow]->setState(oassoc, MESI_S);
+            }
+            print_log_entry(L1->name, "MISS", pc, addr, row, *L1->out);
+            assoc = fill(core, addr, mem, pc, shared_copy ? MESI_S : MESI_E);
+            L1->rows[row]->touch(assoc, index);
+            return L1->readVal(row, assoc, addr, mem);
+        }
+
+        void store(int core, uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) {
+            Cache* L1 = caches[core];
+            int row = L1->rowOf(addr);
+            int index = addr % L1->blocksize;
+            int assoc = L1->rows[row]->inTags(L1->tagOf(addr));
+            L1->classify(addr/L1->blocksize, row, assoc != -1, true);
+            if (assoc != -1) {
+                hits[core]++;
+                //a shared copy needs BusUpgr before the write, E and M write silently
+                if (L1->rows[row]->getState(assoc) == MESI_S) {
+                    bus_upgrades++;
+                    invalidateOthers(core, addr, mem, pc);
+                }
+                L1->rows[row]->pushToTail(assoc);
+            }
+            else {
+                //BusRdX: fetch the block with ownership
+                misses[core]++;
+                bus_read_excl++;
+                invalidateOthers(core, addr, mem, pc);
+                assoc = fill(core, addr, mem, pc, MESI_M);
+            }
+            L1->rows[row]->setState(assoc, MESI_M);
+            L1->rows[row]->setRowVal(assoc, index, val);
+            L1->rows[row]->touch(assoc, index);
+            mem[addr] = val;
+            print_log_entry(L1->name, "SW", pc, addr, row, *L1->out);
+        }
+
+        //print bus traffic, per core hit rates and the blocks that suffer most from false sharing
+        void printStats(vector<Core> &cores, size_t hotspots) {
+            cout << "Coherence traffic: BusRd " << bus_reads << ", BusRdX " << bus_read_excl <<
+                ", BusUpgr " << bus_upgrades << ", flushes " << flushes <<
+                ", writebacks " << writebacks << endl;
+            cout << "Invalidations: " << invalidations << " (false sharing " << false_sharing << ")" << endl;
+            for (size_t i = 0; i < cores.size(); ++i) {
+                cout << "Core " << i << ": pc " << cores[i].machine.pc << ", instructions " << cores[i].machine.steps <<
+                    ", loads " << cores[i].loads << ", stores " << cores[i].stores <<
+                    ", " << caches[i]->name << " hits " << hits[i] << ", misses " << misses[i] << endl;
+            }
+            vector<pair<unsigned long long, int>> hot;
+            for (auto &entry : block_false_sharing) {hot.push_back(make_pair(entry.second, entry.first));}
+            sort(hot.begin(), hot.end(), [](const pair<unsigned long long, int> &a, const pair<unsigned long long, int> &b) {
+                return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+            if (!hot.empty()) {cout << "False sharing hotspots:" << endl;}
+            for (size_t i = 0; i < hot.size() && i < hotspots; ++i) {
+                int blocksize = caches[0]->blocksize;
+                cout << "\tblock addr:" << setw(5) << hot[i].second*blocksize <<
+                    "-" << hot[i].second*blocksize + blocksize - 1 <<
+                    "\tfalse:" << setw(6) << hot[i].first <<
+                    "\tinvalidations:" << setw(6) << block_invalidations[hot[i].second] << endl;
+            }
+        }
+
+    private:
+        vector<Cache*> caches;
+        Cache* shared;
+
+        //bring the block into the core's L1 in the given state, evicting the LRU line
+        int fill(int core, uint16_t addr, unsigned mem[], unsigned pc, int state) {
+            Cache* L1 = caches[core];
+            int row = L1->rowOf(addr);
+            int blockid = addr/L1->blocksize;
+            if (shared != nullptr) {shared->getVal(addr, mem, pc);}
+            int LRU = L1->rows[row]->getLRU();
+            if (L1->rows[row]->isValid(LRU) && L1->rows[row]->getState(LRU) == MESI_M) {
+                writebacks++;
+                if (shared != nullptr) {shared->writeBack(L1->blockAddr(row, L1->rows[row]->getTag(LRU)), mem, pc);}
+            }
+            L1->rows[row]->setRow(LRU, L1->tagOf(addr), mem + blockid*L1->blocksize);
+            L1->rows[row]->setState(LRU, state);
+            L1->rows[row]->clearTouched(LRU);
+            return LRU;
+        }
+
+        //drop every other copy of the block before core writes the word at addr.
+        //An invalidation is false sharing when the victim never touched that word
+        void invalidateOthers(int core, uint16_t addr, unsigned mem[], unsigned pc) {
+            for (size_t other = 0; other < caches.size(); ++other) {
+                if ((int)other == core) {continue;}
+                Cache* C = caches[other];
+                int orow = C->rowOf(addr);
+                int oassoc = C->rows[orow]->inTags(C->tagOf(addr));
+                if (oassoc == -1) {continue;}
+                int blockid = addr/C->blocksize;
+                //an owner flushes its dirty copy before dropping it, as on BusRd
+                if (C->rows[orow]->getState(oassoc) == MESI_M) {
+                    flushes++;
+                    if (shared != nullptr) {shared->writeBack(addr, mem, pc);}
+                }
+                invalidations++;
+                block_invalidations[blockid]++;
+                if (!(C->rows[orow]->getTouched(oassoc) & (uint64_t(1) << (addr % C->blocksize)))) {
+                    false_sharing++;
+                    block_false_sharing[blockid]++;
+                }
+                C->rows[orow]->invalidate(oassoc);
+                if (C->classifier) {C->classifier->invalidate(blockid);}
+                print_log_entry(C->name, "INV", pc, addr, orow, *C->out);
+            }
+        }
+};
+
+/*
+    Runs the cores in lockstep quanta. Each core runs its quantum, then the
+    main thread services the pending memory accesses in core order, so every
+    run is deterministic. Rounds where the cores ran long enough last time
+    are spread over host threads, one per core; the rest, where quanta keep
+    ending at a lw or sw after a few instructions, are run inline on the
+    main thread, as waking the threads would cost more than the quanta.
+
+    @param cores The cores to run, already positioned at their entry points
+    @param bus The coherence bus holding the L1s of the cores
+    @param mem Shared memory
+    @param quantum Most instructions per core between synchronizations; each
+        memory access also ends a core's quantum
+    @param watchdog Step and time limits, checked against the total over all cores
+
+    @return 0, or the watchdog exit status if the run was cut short
+*/
+inline int run_cores(vector<Core> &cores, CoherenceBus &bus, unsigned mem[], int quantum, Watchdog &watchdog) {
+    //instructions the busiest core must have run last round for the next to use the threads
+    const unsigned long long PARALLEL_STEPS = 4096;
+    QuantumBarrier barrier(cores.size() + 1);
+    bool done = false;
+    vector<thread> workers;
+    if (cores.size() > 1 && (unsigned long long)quantum >= PARALLEL_STEPS) {
+        for (size_t i = 0; i < cores.size(); ++i) {
+            workers.emplace_back([&, i] {
+                while (true) {
+                    barrier.wait();
+                    if (done) {return;}
+                    cores[i].runQuantum(quantum);
+                    barrier.wait();
+                }
+            });
+        }
+    }
+    int status = 0;
+    unsigned long long steps = 0;
+    unsigned long long longest = 0;
+    vector<unsigned long long> before(cores.size());
+    while (!done) {
+        for (size_t i = 0; i < cores.size(); ++i) {before[i] = cores[i].machine.steps;}
+        if (!workers.empty() && longest >= PARALLEL_STEPS) {
+            barrier.wait();
+            barrier.wait();
+        }
+        else {
+            for (Core &core : cores) {core.runQuantum(quantum);}
+        }
+        bool running = false;
+        steps = 0;
+        longest = 0;
+        for (size_t i = 0; i < cores.size(); ++i) {
+            Core &core = cores[i];
+            longest = max(longest, core.machine.steps - before[i]);
+            if (core.pending) {
+                uint16_t val = 0;
+                if (core.pending_store) {bus.store(core.id, core.pending_addr, core.machine.regs[core.pending_reg], mem, core.machine.pc);}
+                else {val = bus.load(core.id, core.pending_addr, mem, core.machine.pc);}
+                core.retire(val);
+            }
+            if (!core.machine.halted) {running = true;}
+            steps += core.machine.steps;
+        }
+        if (running && steps >= watchdog.next_check) {
+            status = watchdog.check(steps);
+        }
+        done = !running || status != 0;
+    }
+    //release the workers so they can see done and exit
+    if (!workers.empty()) {barrier.wait();}
+    for (thread &worker : workers) {worker.join();}
+    if (status != 0) {
+        cerr << "Stopped after " << steps << " instructions: " << watchdog.reason << endl;
+    }
+    return status;
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+E20 multi-program library
+Several programs time-sliced on one cache hierarchy, to measure how
+co-running jobs interfere in the caches.
+E20multiprogram.h
+*/
+
+#ifndef E20MULTIPROGRAM_H
+#define E20MULTIPROGRAM_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+
+#include "E20machine.h"
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+//programs that fit, each in its own MEM_SIZE partition of the 16-bit address space the caches see
+size_t const static MAX_PROGRAMS = 8;
+
+/*
+    One of the programs sharing a hierarchy. Its machine runs over its own
+    partition of a physical memory of MAX_PROGRAMS partitions, and its lw
+    and sw reach the shared caches at the partition's physical addresses.
+    The ways it may fill in the last cache level are set before each of
+    its accesses, and the hits and misses the hierarchy counts during them
+    are credited to it.
+*/
+class ProgramSlot : public MemoryHierarchy {
+    public:
+        ProgramSlot(int Index, unsigned Physical[]) : index(Index), base(Index*MEM_SIZE), physical(Physical),
+            machine(Physical + Index*MEM_SIZE) {}
+
+        int index;
+        size_t base;
+        unsigned *physical;
+        E20Machine machine;
+        CacheHierarchy *shared = nullptr;
+        //ways this program may fill in the last level
+        uint64_t ways = ~uint64_t(0);
+        unsigned long long L1_hits = 0;
+        unsigned long long L2_hits = 0;
+        unsigned long long memory_fetches = 0;
+
+        uint16_t load(uint16_t addr, unsigned /*mem*/[], unsigned pc) override {
+            Counts before = take();
+            uint16_t val = shared->load(base + addr, physical, pc);
+            credit(before);
+            return val;
+        }
+
+        void store(uint16_t addr, uint16_t val, unsigned /*mem*/[], unsigned pc) override {
+            Counts before = take();
+            shared->store(base + addr, val, physical, pc);
+            credit(before);
+        }
+
+        //print the hits and misses of one run of this program, with the L1 hit rate
+        void printCounts(const string &label, ostream &out) {
+            unsigned long long accesses = L1_hits + L2_hits + memory_fetches;
+            out << "\t" << label << ": L1 hits " << L1_hits;
+            if (shared->L2 != nullptr) {out << ", L2 hits " << L2_hits;}
+            out << ", memory " << memory_fetches << fixed << setprecision(2) <<
+                " (L1 hit rate " << (accesses ? 100.0*L1_hits/accesses : 0.0) << "%)" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+    private:
+        struct Counts {
+            unsigned long long L1_hits;
+            unsigned long long L2_hits;
+            unsigned long long memory_fetches;
+        };
+
+        //restrict the last level to this program's ways and note the hierarchy's counts
+        Counts take() {
+            (shared->L2 != nullptr ? shared->L2 : shared->L1)->alloc_ways = ways;
+            return Counts{shared->L1_hits, shared->L2_hits, shared->memory_fetches};
+        }
+
+        void credit(const Counts &before) {
+            L1_hits += shared->L1_hits - before.L1_hits;
+            L2_hits += shared->L2_hits - before.L2_hits;
+            memory_fetches += shared->memory_fetches - before.memory_fetches;
+        }
+};
+
+/*
+    Round-robins the programs on their shared hierarchy, slice instructions
+    at a time, until all have halted or the watchdog stops the run.
+
+    @param programs The programs, loaded and attached to the same hierarchy
+    @param slice Instructions each program runs before the next one's turn
+    @param watchdog Step and time limits, checked against the total over all programs
+
+    @return 0, or the watchdog exit status if the run was cut short
+*/
+inline int run_programs(vector<ProgramSlot*> &programs, unsigned long long slice, Watchdog &watchdog) {
+    unsigned long long steps = 0;
+    bool running = true;
+    while (running) {
+        running = false;
+        for (ProgramSlot *program : programs) {
+            if (program->machine.halted) {continue;}
+            //never run past the next check, so step limits stop at the same state
+            steps += program->machine.run(min(slice, watchdog.next_check - steps));
+            if (!program->machine.halted) {running = true;}
+            if (!program->machine.halted && steps >= watchdog.next_check) {
+                int status = watchdog.check(steps);
+                if (status != 0) {
+                    cerr << "Stopped after " << steps << " instructions: " << watchdog.reason << endl;
+                    return status;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+#endif
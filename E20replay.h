@@ -0,0 +1,172 @@
+/*
+E20 replay library
+Records the memory accesses of a run and replays them through a single
+cache on many threads, split by row.
+E20replay.h
+*/
+
+#ifndef E20REPLAY_H
+#define E20REPLAY_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "E20machine.h"
+#include "E20cache.h"
+#include "E20fixedcache.h"
+
+
+using namespace std;
+
+
+//one lw or sw of a recorded run
+struct MemAccess {
+    uint16_t addr;
+    uint16_t pc;
+    bool store;
+};
+
+//memory hierarchy that goes straight to memory and records every access
+class TraceRecorder : public MemoryHierarchy {
+    public:
+        vector<MemAccess> trace;
+
+        uint16_t load(uint16_t addr, unsigned mem[], unsigned pc) override {
+            trace.push_back(MemAccess{addr, (uint16_t)pc, false});
+            return mem[addr];
+        }
+
+        void store(uint16_t addr, uint16_t val, unsigned mem[], unsigned pc) override {
+            trace.push_back(MemAccess{addr, (uint16_t)pc, true});
+            mem[addr] = val;
+        }
+};
+
+/*
+    Bounded queue for exactly one producer and one consumer thread. The two
+    sides only share the head and tail counters, so neither ever blocks the
+    other; a full or empty queue is waited out by yielding.
+*/
+template <typename T>
+class SpscQueue {
+    public:
+        //Capacity must be a power of two
+        SpscQueue(size_t Capacity) : items(Capacity), mask(Capacity - 1) {}
+
+        void push(const T &item) {
+            size_t t = tail.load(memory_order_relaxed);
+            while (t - head.load(memory_order_acquire) == items.size()) {this_thread::yield();}
+            items[t & mask] = item;
+            tail.store(t + 1, memory_order_release);
+        }
+
+        //take the next item, false once the queue is empty and closed
+        bool pop(T &item) {
+            size_t h = head.load(memory_order_relaxed);
+            while (h == tail.load(memory_order_acquire)) {
+                if (closed.load(memory_order_acquire)) {
+                    //a push may have landed between the two loads
+                    if (h == tail.load(memory_order_acquire)) {return false;}
+                    break;
+                }
+                this_thread::yield();
+            }
+            item = items[h & mask];
+            head.store(h + 1, memory_order_release);
+            return true;
+        }
+
+        //no more pushes will follow
+        void close() {closed.store(true, memory_order_release);}
+
+    private:
+        vector<T> items;
+        size_t mask;
+        //kept on separate cache lines so the two threads do not false share them
+        alignas(64) atomic<size_t> head{0};
+        alignas(64) atomic<size_t> tail{0};
+        atomic<bool> closed{false};
+};
+
+/*
+    Replays a recorded access stream through one cache. The rows of a cache
+    never interact, so the stream is split by row into shards, one per
+    thread: the calling thread deals each access to its shard's queue while
+    the shard threads simulate them. Each access's outcome is written to its
+    own slot, so the log can be printed afterwards in program order, and
+    hits and misses are counted per row and merged at the end.
+
+    Only tags are simulated, in a tag store specialized for the cache's
+    geometry where there is one; otherwise blocks are filled from memory
+    as it is after the run.
+*/
+class ParallelReplay {
+    public:
+        ParallelReplay(Cache &c, int Threads) : row_hits(c.rows.size(), 0), row_misses(c.rows.size(), 0),
+            cache(c), threads(max(1, min(Threads, (int)c.rows.size()))) {}
+
+        //outcome of each access of the last replay, true for a hit
+        vector<uint8_t> hit;
+        vector<unsigned long long> row_hits;
+        vector<unsigned long long> row_misses;
+
+        void run(const vector<MemAccess> &trace, unsigned mem[]) {
+            hit.assign(trace.size(), 0);
+            unique_ptr<TagStore> tags(make_tag_store(cache, mem));
+            vector<unique_ptr<SpscQueue<uint32_t>>> queues;
+            for (int i = 0; i < threads; ++i) {queues.emplace_back(new SpscQueue<uint32_t>(4096));}
+            vector<thread> workers;
+            for (int i = 0; i < threads; ++i) {
+                workers.emplace_back([&, i] {
+                    uint32_t n;
+                    while (queues[i]->pop(n)) {
+                        int row = tags->rowOf(trace[n].addr);
+                        hit[n] = tags->access(trace[n].addr);
+                        if (hit[n]) {row_hits[row]++;}
+                        else {row_misses[row]++;}
+                    }
+                });
+            }
+            for (uint32_t n = 0; n < trace.size(); ++n) {
+                queues[cache.rowOf(trace[n].addr) % threads]->push(n);
+            }
+            for (auto &queue : queues) {queue->close();}
+            for (thread &worker : workers) {worker.join();}
+        }
+
+        //print the log of the last replay in program order, as E20cachesim would
+        void printLog(const vector<MemAccess> &trace) {
+            for (size_t n = 0; n < trace.size(); ++n) {
+                const char* status = trace[n].store ? "SW" : hit[n] ? "HIT" : "MISS";
+                print_log_entry(cache.name, status, trace[n].pc, trace[n].addr, cache.rowOf(trace[n].addr), *cache.out);
+            }
+        }
+
+        //print the merged counters of the last replay
+        void printSummary() {
+            unsigned long long hits = 0, misses = 0;
+            for (size_t row = 0; row < row_hits.size(); ++row) {
+                hits += row_hits[row];
+                misses += row_misses[row];
+            }
+            *cache.out << "Replayed " << hits + misses << " accesses on " << threads << " threads: hits " << hits <<
+                ", misses " << misses << endl;
+            for (size_t row = 0; row < row_hits.size(); ++row) {
+                *cache.out << "\trow:" << setw(4) << row << "\thits:" << setw(7) << row_hits[row] <<
+                    "\tmisses:" << setw(7) << row_misses[row] << endl;
+            }
+        }
+
+    private:
+        Cache &cache;
+        int threads;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/*
+E20 result cache
+Keeps the output of finished runs on disk, keyed by a hash of everything
+that determines it, so identical runs can replay it instead of simulating.
+E20resultcache.h
+*/
+
+#ifndef E20RESULTCACHE_H
+#define E20RESULTCACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "E20machine.h"
+
+
+using namespace std;
+
+
+/*
+    A directory of finished runs, one file per run named by a 128-bit hash
+    of the memory image and a description of the run (simulator mode, cache
+    geometry and any options that change the output). Each file holds the
+    exit status and everything the run printed to stdout and stderr.
+
+    Files are written to a temporary name and renamed into place, so other
+    processes only ever see complete entries. A hit touches the file's
+    modification time, which makes it the LRU stamp: after a store, if the
+    directory has grown past max_bytes, the process holding the eviction
+    lock deletes the least recently used entries until it fits again.
+*/
+class ResultCache {
+    public:
+        ResultCache(const string &Dir, unsigned long long MaxBytes) : dir(Dir), max_bytes(MaxBytes) {
+            mkdir(dir.c_str(), 0777);
+        }
+
+        //the name an entry for this image and run description is stored under
+        static string key(const unsigned mem[], const string &run) {
+            uint64_t h1 = 0xcbf29ce484222325ULL;
+            uint64_t h2 = 0x6a09e667f3bcc909ULL;
+            for (size_t addr = 0; addr < MEM_SIZE; ++addr) {
+                h1 = (h1 ^ mem[addr]) * 0x100000001b3ULL;
+                h2 = splitmix64(h2 ^ mem[addr]);
+            }
+            for (unsigned char c : run) {
+                h1 = (h1 ^ c) * 0x100000001b3ULL;
+                h2 = splitmix64(h2 ^ c);
+            }
+            char name[33];
+            snprintf(name, sizeof(name), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)splitmix64(h2));
+            return name;
+        }
+
+        //fill output, errors and status from the entry for key, false on a miss
+        bool lookup(const string &key, string &output, string &errors, int &status) {
+            string path = dir + "/" + key;
+            ifstream f(path, ios::binary);
+            if (!f.is_open()) {
+                return false;
+            }
+            string header;
+            if (!getline(f, header) || header.compare(0, 7, "E20RC2 ") != 0) {
+                return false;
+            }
+            //the header holds the status and the length of the stderr text that comes first
+            istringstream fields(header.substr(7));
+            size_t error_bytes;
+            if (!(fields >> status >> error_bytes)) {
+                return false;
+            }
+            errors.assign(error_bytes, '\0');
+            if (!f.read(&errors[0], error_bytes)) {
+                return false;
+            }
+            ostringstream rest;
+            rest << f.rdbuf();
+            output = rest.str();
+            //bump the LRU stamp
+            utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+            return true;
+        }
+
+        //record the output and stderr text of a finished run under key
+        void store(const string &key, const string &output, const string &errors, int status) {
+            string tmp = dir + "/.tmp." + to_string(getpid()) + "." + key;
+            {
+                ofstream f(tmp, ios::binary | ios::trunc);
+                if (!f.is_open()) {
+                    return;
+                }
+                f << "E20RC2 " << status << " " << errors.size() << "\n" << errors << output;
+                if (!f.good()) {
+                    f.close();
+                    unlink(tmp.c_str());
+                    return;
+                }
+            }
+            if (rename(tmp.c_str(), (dir + "/" + key).c_str()) != 0) {
+                unlink(tmp.c_str());
+                return;
+            }
+            evict();
+        }
+
+    private:
+        string dir;
+        unsigned long long max_bytes;
+
+        //delete least recently used entries until the directory fits in max_bytes
+        void evict() {
+            if (max_bytes == 0) {
+                return;
+            }
+            //only one process evicts at a time, the others skip it
+            int lock = open((dir + "/.lock").c_str(), O_CREAT | O_RDWR, 0666);
+            if (lock < 0) {
+                return;
+            }
+            if (flock(lock, LOCK_EX | LOCK_NB) != 0) {
+                close(lock);
+                return;
+            }
+            struct Entry {
+                long long stamp;
+                string path;
+                unsigned long long bytes;
+            };
+            vector<Entry> entries;
+            unsigned long long total = 0;
+            DIR *d = opendir(dir.c_str());
+            if (d != nullptr) {
+                struct dirent *ent;
+                while ((ent = readdir(d)) != nullptr) {
+                    if (ent->d_name[0] == '.') {
+                        continue;
+                    }
+                    string path = dir + "/" + ent->d_name;
+                    struct stat st;
+                    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                        long long stamp = (long long)st.st_mtim.tv_sec*1000000000LL + st.st_mtim.tv_nsec;
+                        entries.push_back(Entry{stamp, path, (unsigned long long)st.st_size});
+                        total += st.st_size;
+                    }
+                }
+                closedir(d);
+            }
+            if (total > max_bytes) {
+                sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {return a.stamp < b.stamp;});
+                for (size_t i = 0; i < entries.size() && total > max_bytes; ++i) {
+                    //a reader that already opened the file keeps its copy
+                    unlink(entries[i].path.c_str());
+                    total -= entries[i].bytes;
+                }
+            }
+            flock(lock, LOCK_UN);
+            close(lock);
+        }
+};
+
+/*
+    One run under a ResultCache: either prints the output of an identical
+    earlier run, or captures what this run writes to stdout and stderr
+    until finish prints and stores it. Stderr is kept for the line saying
+    why a run stopped early.
+*/
+class CachedRun {
+    public:
+        CachedRun(const string &Dir, unsigned long long MaxBytes, const unsigned mem[], const string &run) :
+            cache(Dir, MaxBytes), key(ResultCache::key(mem, run)) {}
+
+        ~CachedRun() {release();}
+
+        //print an identical earlier run and set its status, or return false and start capturing
+        bool replay(int &status) {
+            string output, errors;
+            if (cache.lookup(key, output, errors, status)) {
+                cerr << errors;
+                cout << output;
+                return true;
+            }
+            console = cout.rdbuf(captured.rdbuf());
+            console_errors = cerr.rdbuf(captured_errors.rdbuf());
+            return false;
+        }
+
+        //stop capturing, then print what the run wrote and store it with its status
+        void finish(int status) {
+            release();
+            cerr << captured_errors.str();
+            cout << captured.str();
+            cache.store(key, captured.str(), captured_errors.str(), status);
+        }
+
+    private:
+        ResultCache cache;
+        string key;
+        ostringstream captured;
+        ostringstream captured_errors;
+        streambuf *console = nullptr;
+        streambuf *console_errors = nullptr;
+
+        //give the console its streams back
+        void release() {
+            if (console != nullptr) {
+                cout.rdbuf(console);
+                cerr.rdbuf(console_errors);
+                console = nullptr;
+            }
+        }
+};
+
+#endif
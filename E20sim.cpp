@@ -1,371 +1,597 @@
-/*
-CS-UY 2214
-Adapted from Jeff Epstein
-Starter code for E20 simulator
-sim.cpp
-*/
-
-
-#include <cstddef>
-#include <iostream>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <iomanip>
-#include <regex>
-#include <cstdlib>
-
-
-using namespace std;
-
-
-// Some helpful constant values that we'll be using.
-size_t const static NUM_REGS = 8;
-size_t const static MEM_SIZE = 1<<13;
-size_t const static REG_SIZE = 1<<16;
-
-
-/*
-    Loads an E20 machine code file into the list
-    provided by mem. We assume that mem is
-    large enough to hold the values in the machine
-    code file.
-
-
-    @param f Open file to read from
-    @param mem Array represetnting memory into which to read program
-*/
-void load_machine_code(ifstream &f, unsigned mem[])
-{
-    regex machine_code_re("^ram\\[(\\d+)\\] = 16'b(\\d+);.*$");
-    size_t expectedaddr = 0;
-    string line;
-    while (getline(f, line))
-    {
-        smatch sm;
-        if (!regex_match(line, sm, machine_code_re))
-        {
-            cerr << "Can't parse line: " << line << endl;
-            exit(1);
-        }
-        size_t addr = stoi(sm[1], nullptr, 10);
-        unsigned instr = stoi(sm[2], nullptr, 2);
-        if (addr != expectedaddr)
-        {
-            cerr << "Memory addresses encountered out of sequence: " << addr << endl;
-            exit(1);
-        }
-        if (addr >= MEM_SIZE)
-        {
-            cerr << "Program too big for memory" << endl;
-            exit(1);
-        }
-        expectedaddr++;
-        mem[addr] = instr;
-    }
-}
-
-
-/*
-    Prints the current state of the simulator, including
-    the current program counter, the current register values,
-    and the first memquantity elements of memory.
-
-
-    @param pc The final value of the program counter
-    @param regs Final value of all registers
-    @param memory Final value of memory
-    @param memquantity How many words of memory to dump
-*/
-void print_state(unsigned pc, unsigned regs[], unsigned memory[], size_t memquantity)
-{
-    cout << setfill(' ');
-    cout << "Final state:" << endl;
-    cout << "\tpc=" << setw(5) << pc << endl;
-
-
-    for (size_t reg = 0; reg < NUM_REGS; reg++)
-        cout << "\t$" << reg << "=" << setw(5) << regs[reg] << endl;
-
-
-    cout << setfill('0');
-    bool cr = false;
-    for (size_t count = 0; count < memquantity; count++)
-    {
-        cout << hex << setw(4) << memory[count] << " ";
-        cr = true;
-        if (count % 8 == 7)
-        {
-            cout << endl;
-            cr = false;
-        }
-    }
-    if (cr)
-        cout << endl;
-}
-
-uint16_t fix_bit_length(uint16_t val) {
-    return val = val & 0b1111111111111111;
-}
-
-uint16_t fix_bit_length13(uint16_t val) {
-    return val = val & 0b1111111111111;
-}
-
-uint16_t convert_neg_imm(uint16_t val) {
-    val = (~val & 0b0000000001111111) + 0b1;
-    return val;
-}
-
-uint16_t sign_extend_imm7(uint16_t val) {
-    if (val & 0b1000000) {
-        return val |= 0b1111111111000000;
-    }
-    else {
-        return val;
-    }
-}
-
-
-/**
-    Main function
-    Takes command-line args as documented below
-*/
-int main(int argc, char* argv[])
-{
-    /*
-        Parse the command-line arguments
-    */
-    char* filename = nullptr;
-    bool do_help = false;
-    bool arg_error = false;
-    for (int i = 1; i < argc; i++)
-    {
-        string arg(argv[i]);
-        if (arg.rfind("-", 0) == 0)
-        {
-            if (arg == "-h" || arg == "--help") {
-                do_help = true;
-            }
-            else {
-                arg_error = true;
-            }
-        }
-        else
-        {
-            if (filename == nullptr) {
-                filename = argv[i];
-            }
-            else {
-                arg_error = true;
-            }
-        }
-    }
-    /* Display error message if appropriate */
-    if (arg_error || do_help || filename == nullptr)
-    {
-        cerr << "usage " << argv[0] << " [-h] filename" << endl << endl;
-        cerr << "Simulate E20 machine" << endl << endl;
-        cerr << "positional arguments:" << endl;
-        cerr << "  filename    The file containing machine code, typically with .bin suffix" << endl << endl;
-        cerr << "optional arguments:" << endl;
-        cerr << "  -h, --help  show this help message and exit" << endl;
-        return 1;
-    }
-    
-    ifstream f(filename);
-    if (!f.is_open())
-    {
-        cerr << "Can't open file " << filename << endl;
-        return 1;
-    }
-    // TODO: your code here. Load f and parse using load_machine_code
-    unsigned memory[MEM_SIZE] = { 0 };
-    unsigned regs[NUM_REGS] = { 0 };
-    unsigned pc = 0b0000000000000000;
-    bool stop = false;
-    load_machine_code(f, memory);
-    f.close();
-    // TODO: your code here. Do simulation.
-    uint16_t op = 0b0000000000000000;
-    uint16_t imm = 0b0000000000000000;
-    uint16_t regA = 0b0000000000000000;
-    uint16_t regB = 0b0000000000000000;
-    uint16_t regDst = 0b0000000000000000;
-    while (stop == false)
-    {
-        //get the instruction bits and shift to the right 13 to obtain the opcode
-        uint16_t instruction = memory[pc];
-        op = (instruction & 0b1110000000000000) >> 13;
-        //3 registers instructions
-        if (op == 0)
-        {
-            //get the immediate value, regA, regB, and regDst from the instruction
-            imm = instruction & 0b0000000000001111;
-            regA = (instruction & 0b0001110000000000) >> 10;
-            regB = (instruction & 0b0000001110000000) >> 7;
-            regDst = (instruction & 0b0000000001110000) >> 4;
-            //add
-            if (imm == 0)
-            {
-                //add two registers and store value into destination
-                regs[regDst] = regs[regA] + regs[regB];
-                pc += 1;
-            }
-            //sub
-            else if (imm == 1)
-            {
-                //subtract two registers and store value into destination
-                regs[regDst] = regs[regA] - regs[regB];
-                pc += 1;
-            }
-            //or
-            else if (imm == 2)
-            {
-                //or two registers and store value in desination
-                regs[regDst] = regs[regA] | regs[regB];
-                pc += 1;
-            }
-            //and
-            else if (imm == 3)
-            {
-                //and two registers and store value in destination
-                regs[regDst] = regs[regA] & regs[regB];
-                pc += 1;
-            }
-            //slt
-            else if (imm == 4)
-            {
-                //set regDst to 1 if regA < regB and 0 otherwise
-                if (regs[regA] < regs[regB])
-                    {regs[regDst] = 1;}
-                else
-                    {regs[regDst] = 0;}
-                pc += 1;
-            }
-            //jr
-            else if (imm == 8)
-            {
-                //if the immediate value is the same as the pc then it will result in a infinite loop so program is stopped if true
-                //and jumps to value in regA otherwise
-                if (regs[regA] == pc)
-                {
-                    stop = true;
-                }
-                else
-                {
-                    pc = regs[regA];
-                }
-            }
-        }
-        //0 register instructions
-        else if (op == 2 || op == 3)
-        {
-            //setup immmediate value from instructions
-            imm = instruction & 0b0001111111111111;
-            //j
-            if (op == 2)
-            {
-                // if immediate value is equal to pc it results in infinite loop so program is stopped and jumps to imm otherwise
-                if (imm == pc)
-                {
-                    stop = true;
-                }
-                else
-                {
-                    pc = imm;
-                }
-            }
-            //jal
-            else if (op == 3)
-            {
-                //sets value of register 7 to current memory address + 1 and jumps to immediate value
-                //if it does not result in an infinite loop
-                regs[7] = pc + 1;
-                if (imm == pc)
-                {
-                    stop = true;
-                }
-                else
-                {
-                    pc = imm;
-                }
-            }
-        }
-        //2 registers instructions
-        else
-        {
-            //setup imm, and register numbers from instruction
-            imm = instruction & 0b0000000001111111;
-            regA = (instruction & 0b0001110000000000) >> 10;
-            regB = (instruction & 0b0000001110000000) >> 7;
-            //sign extends immediate value for calculations
-            uint16_t ext_imm = sign_extend_imm7(imm);
-            //addi
-            if (op == 1)
-            {
-                //adds source reg and imm into destination
-                regs[regB] = regs[regA] + ext_imm;
-                regs[regB] = fix_bit_length(regs[regB]);
-                pc += 1;
-            }
-            //lw
-            else if (op == 4)
-            {
-                //stores the value at the memory location at immediate plus addr reg into destination
-                regs[regB] = memory[fix_bit_length13(ext_imm + regs[regA])];
-                pc += 1;
-            }
-            //sw 
-            else if (op == 5)
-            {
-                //stores value in source register into memory cell located from sum of immediate and value at addr register
-                memory[fix_bit_length13(ext_imm + regs[regA])] = regs[regB];
-                pc += 1;
-            }
-            //jeq
-            else if (op == 6)
-            {
-                //checks if two registers are equal and jumps if true, increments by one otherwise
-                if (regs[regA] == regs[regB])
-                {
-                    if ((pc + ext_imm + 0b1) % 128 == pc)
-                    {
-                        stop = true;
-                    }
-                    else
-                    {
-                        pc = (pc + ext_imm + 0b1)%128;
-                    }
-                }
-                else {
-                    pc += 1;
-                }
-                
-            }
-            //slti
-            else if (op == 7)
-            {
-                //checks if register value is less than immediate value and set destination to 1 or 0 accordingly
-                regs[regB] = (regs[regA] < ext_imm) ? 1:0;
-                pc += 1;
-            }
-        }
-        
-        //ensure pc is within range
-        pc &= 0b1111111111111;
-
-        //ensure all register values are greater than 0 and less than reg_size, and wraparound if otherwise
-        for (unsigned i : regs) {
-            i &= 0b1111111111111111;
-        }
-
-        //make sure register 0 is 0
-        regs[0] = 0b0000000000000000;
-    }
-    // TODO: your code here. print the final state of the simulator before ending, using print_state
-    print_state(pc, regs, memory, 128);
-    return 0;
-}
-
+/*
+CS-UY 2214
+Adapted from Jeff Epstein
+Starter code for E20 simulator
+sim.cpp
+*/
+
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <sstream>
+#include <deque>
+#include <set>
+#include <memory>
+
+#include "E20machine.h"
+#include "E20resultcache.h"
+#include "E20fastforward.h"
+#include "E20batch.h"
+#include "E20metrics.h"
+
+
+using namespace std;
+
+
+/*
+    Runs the machine under debugger commands, with reverse execution.
+
+    Every executed instruction appends an UndoEntry to a journal, so stepping
+    back is a pop and an undo. The journal is capped; full snapshots of the
+    machine taken every snapshot_interval steps let any earlier step be
+    reached by restoring the nearest snapshot and replaying at most
+    snapshot_interval instructions. When the snapshot list fills up every
+    other snapshot is dropped and the interval doubles.
+
+    Step and continue stop when the watchdog's step or time limit is hit,
+    reported as run_watched does; going back and replaying is not limited.
+*/
+class ReverseDebugger {
+    public:
+        ReverseDebugger(E20Machine &machine, size_t JournalLimit, unsigned long long Interval, Watchdog &Dog) :
+        pc(machine.pc), regs(machine.regs), memory(machine.memory), journal_limit(JournalLimit), snapshot_interval(Interval),
+        watchdog(Dog)
+        {
+            takeSnapshot();
+        }
+
+        /*
+            Reads commands from in until quit or end of input:
+                step [n], reverse-step [n], continue, reverse-continue PC,
+                break PC, delete, print, quit
+
+            @return The watchdog's exit status if it stopped the last step or continue, else 0
+        */
+        int run(istream &in, bool interactive) {
+            string line;
+            while (true) {
+                if (interactive) {
+                    cerr << "(e20) " << flush;
+                }
+                if (!getline(in, line)) {
+                    break;
+                }
+                istringstream words(line);
+                string cmd;
+                if (!(words >> cmd)) {
+                    continue;
+                }
+                unsigned long long arg = 1;
+                bool has_arg = static_cast<bool>(words >> arg);
+                if (cmd == "quit" || cmd == "q") {
+                    break;
+                }
+                else if (cmd == "step" || cmd == "s") {
+                    status = forward(arg, false, true);
+                }
+                else if (cmd == "reverse-step" || cmd == "rs") {
+                    goTo(arg > steps ? 0 : steps - arg);
+                }
+                else if (cmd == "continue" || cmd == "c") {
+                    status = forward(ULLONG_MAX, true, true);
+                }
+                else if ((cmd == "reverse-continue" || cmd == "rc") && has_arg) {
+                    reverseContinue(arg & 0b1111111111111);
+                }
+                else if ((cmd == "break" || cmd == "b") && has_arg) {
+                    breakpoints.insert(arg & 0b1111111111111);
+                }
+                else if (cmd == "delete" || cmd == "d") {
+                    breakpoints.clear();
+                }
+                else if (cmd == "print" || cmd == "p") {
+                    print_state(pc, regs, memory, 128);
+                    continue;
+                }
+                else {
+                    cerr << "Unknown command: " << line << endl;
+                    continue;
+                }
+                cout << "step " << steps << " pc " << pc << (halted ? " halted" : "") << endl;
+            }
+            return status;
+        }
+
+    private:
+        struct Snapshot {
+            unsigned long long steps;
+            unsigned pc;
+            vector<unsigned> regs;
+            vector<unsigned> memory;
+        };
+        size_t const static MAX_SNAPSHOTS = 64;
+
+        unsigned &pc;
+        unsigned *regs;
+        unsigned *memory;
+        size_t journal_limit;
+        unsigned long long snapshot_interval;
+        unsigned long long steps = 0;
+        bool halted = false;
+        deque<UndoEntry> journal;
+        vector<Snapshot> snapshots;
+        set<unsigned> breakpoints;
+        Watchdog &watchdog;
+        int status = 0;
+
+        //execute one instruction, journaling it and snapshotting on interval boundaries
+        void stepOne() {
+            UndoEntry undo;
+            halted = execute_instruction(pc, regs, memory, &undo, nullptr);
+            journal.push_back(undo);
+            if (journal.size() > journal_limit) {
+                journal.pop_front();
+            }
+            steps++;
+            if (steps % snapshot_interval == 0) {
+                takeSnapshot();
+            }
+        }
+
+        //run up to n instructions, stopping at a halt and optionally at breakpoints and
+        //the watchdog's limits, returns the watchdog's exit status if it stopped the run
+        int forward(unsigned long long n, bool at_breakpoints, bool watched) {
+            for (unsigned long long i = 0; i < n && !halted; ++i) {
+                stepOne();
+                if (watched && !halted && steps >= watchdog.next_check) {
+                    int stopped = watchdog.check(steps);
+                    if (stopped != 0) {
+                        cerr << "Stopped at pc " << pc << " after " << steps << " instructions: " << watchdog.reason << endl;
+                        return stopped;
+                    }
+                }
+                if (at_breakpoints && breakpoints.count(pc)) {
+                    break;
+                }
+            }
+            return 0;
+        }
+
+        void takeSnapshot() {
+            //the machine is deterministic, so snapshots past the current step stay valid
+            if (!snapshots.empty() && snapshots.back().steps >= steps) {
+                return;
+            }
+            if (snapshots.size() == MAX_SNAPSHOTS) {
+                //keep every other snapshot and space future ones twice as far apart
+                vector<Snapshot> kept;
+                for (size_t i = 0; i < snapshots.size(); i += 2) {
+                    kept.push_back(snapshots[i]);
+                }
+                snapshots.swap(kept);
+                snapshot_interval *= 2;
+                if (steps % snapshot_interval != 0) {
+                    return;
+                }
+            }
+            snapshots.push_back(Snapshot{steps, pc, vector<unsigned>(regs, regs + NUM_REGS), vector<unsigned>(memory, memory + MEM_SIZE)});
+        }
+
+        //restore the latest snapshot at or before target
+        void restoreBefore(unsigned long long target) {
+            size_t i = snapshots.size() - 1;
+            while (i > 0 && snapshots[i].steps > target) {
+                i--;
+            }
+            Snapshot &snap = snapshots[i];
+            steps = snap.steps;
+            pc = snap.pc;
+            copy(snap.regs.begin(), snap.regs.end(), regs);
+            copy(snap.memory.begin(), snap.memory.end(), memory);
+            journal.clear();
+            halted = false;
+        }
+
+        //move the machine to the state after target instructions, target <= steps
+        void goTo(unsigned long long target) {
+            if (target >= steps) {
+                return;
+            }
+            if (steps - target <= journal.size()) {
+                while (steps > target) {
+                    apply_undo(pc, regs, memory, journal.back());
+                    journal.pop_back();
+                    steps--;
+                }
+                halted = false;
+                return;
+            }
+            restoreBefore(target);
+            forward(target - steps, false, false);
+        }
+
+        //go back to the most recent earlier step whose pc is target, or to step 0
+        void reverseContinue(unsigned target) {
+            //walk back through the journal first
+            while (!journal.empty()) {
+                apply_undo(pc, regs, memory, journal.back());
+                journal.pop_back();
+                steps--;
+                halted = false;
+                if (pc == target) {
+                    return;
+                }
+            }
+            //then search one snapshot window at a time, newest first
+            unsigned long long end = steps;
+            while (end > 0) {
+                restoreBefore(end - 1);
+                unsigned long long start = steps;
+                unsigned long long found = ULLONG_MAX;
+                for (unsigned long long at = start; at < end; ++at) {
+                    if (pc == target) {
+                        found = at;
+                    }
+                    stepOne();
+                }
+                if (found != ULLONG_MAX) {
+                    goTo(found);
+                    return;
+                }
+                end = start;
+                if (start == 0) {
+                    goTo(0);
+                    return;
+                }
+            }
+        }
+};
+
+
+/*
+    Runs every machine code file named in a list as one lane of a
+    BatchMachine, then prints each lane's final state in list order.
+
+    @param list File naming one machine code file per line
+    @param max_steps Most instructions any lane executes
+    @param time_limit Seconds of wall-clock time before the batch stops, 0 for none
+
+    @return 0, the watchdog exit status if lanes were still running, or 1 on a bad list
+*/
+static int run_batch(const char *list, unsigned long long max_steps, double time_limit)
+{
+    ifstream names(list);
+    if (!names.is_open()) {
+        cerr << "Can't open file " << list << endl;
+        return 1;
+    }
+    vector<string> files;
+    string line;
+    while (getline(names, line)) {
+        if (!line.empty()) {files.push_back(line);}
+    }
+    if (files.empty() || files.size() > MAX_BATCH_LANES) {
+        cerr << "A batch needs 1 to " << MAX_BATCH_LANES << " files, " << list << " names " << files.size() << endl;
+        return 1;
+    }
+    BatchMachine batch(files.size());
+    vector<unsigned> image(MEM_SIZE);
+    for (size_t lane = 0; lane < files.size(); ++lane) {
+        ifstream f(files[lane]);
+        if (!f.is_open()) {
+            cerr << "Can't open file " << files[lane] << endl;
+            return 1;
+        }
+        fill(image.begin(), image.end(), 0);
+        load_machine_code(f, image.data());
+        batch.load(lane, image.data());
+    }
+    //lanes run different numbers of instructions per round, so the batch keeps each lane's
+    //step limit itself and the watchdog only keeps time, checked every so many rounds
+    Watchdog watchdog(ULLONG_MAX, time_limit, false);
+    int status = 0;
+    while (status == 0 && !batch.run(max_steps, watchdog.next_check - batch.rounds)) {
+        status = watchdog.check(batch.rounds);
+    }
+    unsigned long long running = 0;
+    for (size_t lane = 0; lane < files.size(); ++lane) {
+        unsigned regs[NUM_REGS];
+        for (size_t reg = 0; reg < NUM_REGS; ++reg) {regs[reg] = batch.laneReg(lane, reg);}
+        for (size_t addr = 0; addr < 128; ++addr) {image[addr] = batch.laneWord(lane, addr);}
+        cout << "Lane " << lane << ": " << files[lane] << endl;
+        print_state(batch.lanePc(lane), regs, image.data(), 128);
+        if (!batch.laneHalted(lane)) {running++;}
+    }
+    if (status == 0 && running > 0) {
+        status = EXIT_BUDGET;
+        watchdog.reason = "step limit reached";
+    }
+    if (status != 0) {
+        cerr << "Stopped " << running << " of " << files.size() << " lanes: " << watchdog.reason << endl;
+    }
+    unsigned long long lane_steps = batch.vector_steps + batch.scalar_steps;
+    cerr << "Batch of " << files.size() << " lanes: " << batch.rounds << " block rounds, " << lane_steps <<
+        " instructions, " << fixed << setprecision(2) << (lane_steps ? 100.0*batch.vector_steps/lane_steps : 0.0) <<
+        "% executed in groups of lanes" << endl;
+    cerr.unsetf(ios::floatfield);
+    cerr << setprecision(6);
+    return status;
+}
+
+
+/**
+    Main function
+    Takes command-line args as documented below
+*/
+int main(int argc, char* argv[])
+{
+    /*
+        Parse the command-line arguments
+    */
+    char* filename = nullptr;
+    bool do_help = false;
+    bool arg_error = false;
+    unsigned long long max_steps = ULLONG_MAX;
+    double time_limit = 0;
+    bool detect_loops = false;
+    bool debug = false;
+    bool fast_forward = false;
+    char* script = nullptr;
+    size_t journal_limit = 1<<20;
+    unsigned long long snapshot_interval = 1<<16;
+    char* result_dir = nullptr;
+    unsigned long long result_cache_mb = 256;
+    char* batch_list = nullptr;
+    char* metrics_file = nullptr;
+    MetricsFormat metrics_format = METRICS_JSON;
+    unsigned long long metrics_interval = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg(argv[i]);
+        if (arg.rfind("-", 0) == 0)
+        {
+            if (arg == "-h" || arg == "--help") {
+                do_help = true;
+            }
+            else if (arg == "--detect-loops") {
+                detect_loops = true;
+            }
+            else if (arg == "--debug") {
+                debug = true;
+            }
+            else if (arg == "--fast-forward") {
+                fast_forward = true;
+            }
+            else if (arg == "--script") {
+                i++;
+                if (i >= argc) {
+                    arg_error = true;
+                }
+                else {
+                    debug = true;
+                    script = argv[i];
+                }
+            }
+            else if (arg == "--result-cache") {
+                i++;
+                if (i >= argc) {
+                    arg_error = true;
+                }
+                else {
+                    result_dir = argv[i];
+                }
+            }
+            else if (arg == "--batch") {
+                i++;
+                if (i >= argc) {
+                    arg_error = true;
+                }
+                else {
+                    batch_list = argv[i];
+                }
+            }
+            else if (arg == "--metrics") {
+                i++;
+                if (i >= argc) {
+                    arg_error = true;
+                }
+                else {
+                    metrics_file = argv[i];
+                }
+            }
+            else if (arg == "--metrics-format") {
+                i++;
+                if (i >= argc || (string(argv[i]) != "json" && string(argv[i]) != "prometheus")) {
+                    arg_error = true;
+                }
+                else {
+                    metrics_format = string(argv[i]) == "json" ? METRICS_JSON : METRICS_PROMETHEUS;
+                }
+            }
+            else if (arg == "--metrics-interval") {
+                i++;
+                if (i >= argc || (metrics_interval = strtoull(argv[i], nullptr, 10)) == 0) {
+                    arg_error = true;
+                }
+            }
+            else if (arg == "--result-cache-mb") {
+                i++;
+                if (i >= argc) {
+                    arg_error = true;
+                }
+                else {
+                    result_cache_mb = strtoull(argv[i], nullptr, 10);
+                }
+            }
+            else if (arg == "--journal" || arg == "--snapshot-interval") {
+                i++;
+                if (i >= argc || strtoull(argv[i], nullptr, 10) == 0) {
+                    arg_error = true;
+                }
+                else if (arg == "--journal") {
+                    journal_limit = strtoull(argv[i], nullptr, 10);
+                }
+                else {
+                    snapshot_interval = strtoull(argv[i], nullptr, 10);
+                }
+            }
+            else if (arg == "--max-steps" || arg == "--time-limit") {
+                i++;
+                if (i >= argc || atof(argv[i]) <= 0) {
+                    arg_error = true;
+                }
+                else if (arg == "--max-steps") {
+                    max_steps = strtoull(argv[i], nullptr, 10);
+                }
+                else {
+                    time_limit = atof(argv[i]);
+                }
+            }
+            else {
+                arg_error = true;
+            }
+        }
+        else
+        {
+            if (filename == nullptr) {
+                filename = argv[i];
+            }
+            else {
+                arg_error = true;
+            }
+        }
+    }
+    //stuck loop detection samples back-edges, so skipping iterations would move where it stops,
+    //and the debugger's reverse steps would leave the state it hashes behind
+    if ((fast_forward && (detect_loops || debug)) || (debug && detect_loops)) {
+        arg_error = true;
+    }
+    //a batch takes its images from the list instead of a filename, and only runs to the end
+    if (batch_list != nullptr && (filename != nullptr || detect_loops || debug || fast_forward || result_dir != nullptr)) {
+        arg_error = true;
+    }
+    //fast-forward skips the instructions metrics count, and the debugger and batches run their own loops
+    if ((metrics_file != nullptr && (fast_forward || debug || batch_list != nullptr)) ||
+            (metrics_interval > 0 && metrics_file == nullptr)) {
+        arg_error = true;
+    }
+    /* Display error message if appropriate */
+    if (arg_error || do_help || (filename == nullptr && batch_list == nullptr))
+    {
+        cerr << "usage " << argv[0] << " [-h] [--max-steps N] [--time-limit SECONDS] [--detect-loops]" << endl;
+        cerr << "       [--fast-forward] [--debug] [--script FILE] [--journal N] [--snapshot-interval K]" << endl;
+        cerr << "       [--result-cache DIR] [--result-cache-mb MB] [--metrics FILE]" << endl;
+        cerr << "       [--metrics-format FORMAT] [--metrics-interval N] filename" << endl;
+        cerr << "       " << argv[0] << " [--max-steps N] [--time-limit SECONDS] --batch LIST" << endl << endl;
+        cerr << "Simulate E20 machine" << endl << endl;
+        cerr << "positional arguments:" << endl;
+        cerr << "  filename    The file containing machine code, typically with .bin suffix" << endl << endl;
+        cerr << "optional arguments:" << endl;
+        cerr << "  -h, --help  show this help message and exit" << endl;
+        cerr << "  --max-steps N          stop after N instructions (exit status " << EXIT_BUDGET << ")" << endl;
+        cerr << "  --time-limit SECONDS   stop after SECONDS of wall-clock time (exit status " << EXIT_BUDGET << ")" << endl;
+        cerr << "  --detect-loops         stop when the machine provably loops forever (exit status " << EXIT_STUCK << ")" << endl;
+        cerr << "  --fast-forward         jump over iterations of loops with a fixed per-iteration effect;" << endl;
+        cerr << "                         the final state is unchanged (not with --detect-loops or --debug)" << endl;
+        cerr << "  --debug                read debugger commands from stdin: step [n], reverse-step [n]," << endl;
+        cerr << "                         continue, reverse-continue PC, break PC, delete, print, quit;" << endl;
+        cerr << "                         --max-steps and --time-limit stop step and continue" << endl;
+        cerr << "                         (not with --detect-loops)" << endl;
+        cerr << "  --script FILE          read debugger commands from FILE" << endl;
+        cerr << "  --journal N            undo journal entries kept for reverse steps (default 1048576)" << endl;
+        cerr << "  --snapshot-interval K  instructions between debugger snapshots (default 65536)" << endl;
+        cerr << "  --result-cache DIR     reuse the output of identical earlier runs stored in DIR" << endl;
+        cerr << "                         (not used with --time-limit, --metrics or the debugger)" << endl;
+        cerr << "  --result-cache-mb MB   evict least recently used results past MB megabytes" << endl;
+        cerr << "                         (default 256, 0 for no limit)" << endl;
+        cerr << "  --metrics FILE         write instructions retired in all and by opcode, and the host" << endl;
+        cerr << "                         time of the load and simulate phases, to FILE at the end" << endl;
+        cerr << "                         (not with --fast-forward, --debug or --batch)" << endl;
+        cerr << "  --metrics-format FORMAT" << endl;
+        cerr << "                         json (default, one object per line) or prometheus (text" << endl;
+        cerr << "                         format, the file replaced by each snapshot)" << endl;
+        cerr << "  --metrics-interval N   also write metrics every N instructions" << endl;
+        cerr << "  --batch LIST           run the machine code files named one per line in LIST side by side," << endl;
+        cerr << "                         typically one program with different data, and print each final state" << endl;
+        return 1;
+    }
+    if (batch_list != nullptr) {
+        return run_batch(batch_list, max_steps, time_limit);
+    }
+    unique_ptr<Metrics> metrics;
+    if (metrics_file != nullptr) {
+        metrics.reset(new Metrics(metrics_file, metrics_format));
+        if (!metrics->ok) {
+            cerr << "Can't open file " << metrics_file << endl;
+            return 1;
+        }
+        metrics->phase("load");
+    }
+    
+    ifstream f(filename);
+    if (!f.is_open())
+    {
+        cerr << "Can't open file " << filename << endl;
+        return 1;
+    }
+    // TODO: your code here. Load f and parse using load_machine_code
+    E20Machine machine;
+    machine.load(f);
+    f.close();
+    // TODO: your code here. Do simulation.
+    if (debug) {
+        Watchdog watchdog(max_steps, time_limit, false);
+        ReverseDebugger debugger(machine, journal_limit, snapshot_interval, watchdog);
+        if (script != nullptr) {
+            ifstream commands(script);
+            if (!commands.is_open()) {
+                cerr << "Can't open file " << script << endl;
+                return 1;
+            }
+            return debugger.run(commands, false);
+        }
+        return debugger.run(cin, true);
+    }
+    //replay an identical earlier run if the result cache has one. Runs cut short by
+    //the wall clock are not repeatable, so they are never cached, and metrics need a real run
+    unique_ptr<CachedRun> cached;
+    if (result_dir != nullptr && time_limit == 0 && !metrics) {
+        cached.reset(new CachedRun(result_dir, result_cache_mb << 20, machine.memory, "E20sim max_steps=" +
+            to_string(max_steps) + (detect_loops ? " detect_loops" : "")));
+        int status;
+        if (cached->replay(status)) {
+            return status;
+        }
+    }
+    Watchdog watchdog(max_steps, time_limit, detect_loops);
+    if (metrics) {
+        machine.countOpcodes();
+        add_machine_metrics(*metrics, machine);
+        if (metrics_interval > 0) {watchdog.every(metrics_interval, [&](unsigned long long) {metrics->write(false);});}
+        metrics->phase("simulate");
+    }
+    int status;
+    if (fast_forward) {
+        LoopFastForward loops;
+        status = run_fast_forward(machine, watchdog, loops);
+    }
+    else {
+        status = run_watched(machine, watchdog);
+    }
+    if (metrics && !metrics->write(true)) {
+        cerr << "Can't write metrics to " << metrics_file << endl;
+    }
+    // TODO: your code here. print the final state of the simulator before ending, using print_state
+    print_state(machine.pc, machine.regs, machine.memory, 128);
+    if (cached) {cached->finish(status);}
+    return status;
+}
+
 //ra0Eequ6ucie6Jei0koh6phishohm9
\ No newline at end of file
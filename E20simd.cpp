@@ -0,0 +1,379 @@
+/*
+E20 simulation daemon
+Runs E20sim and E20cachesim jobs sent over a Unix domain socket,
+so callers pay for process startup once instead of per run.
+E20simd.cpp
+*/
+
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "E20machine.h"
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+/*
+    One simulation request. A connection sends any number of jobs:
+
+        JOB name
+        CACHE size,assoc,blocksize[,size,assoc,blocksize]   (optional)
+        MAXSTEPS n                                          (optional)
+        TIMELIMIT seconds                                   (optional)
+        ram[0] = 16'b...;
+        ...
+        END
+
+    and gets back, for each, exactly what E20cachesim (with CACHE) or
+    E20sim (without) would print, followed by
+
+        Final state: ...     (with CACHE, when E20cachesim would not print it)
+        STATS steps=n status=s micros=t
+        DONE name
+*/
+struct Job {
+    string name;
+    string cache_config;
+    unsigned long long max_steps = ULLONG_MAX;
+    double time_limit = 0;
+    vector<unsigned> image;
+    //set when the request could not be parsed
+    string error;
+};
+
+//buffered line reader over a socket
+class LineReader {
+    public:
+        LineReader(int Fd) : fd(Fd) {}
+
+        bool getLine(string &line) {
+            while (true) {
+                size_t nl = buffer.find('\n', start);
+                if (nl != string::npos) {
+                    line.assign(buffer, start, nl - start);
+                    if (!line.empty() && line.back() == '\r') {line.pop_back();}
+                    start = nl + 1;
+                    return true;
+                }
+                buffer.erase(0, start);
+                start = 0;
+                char chunk[65536];
+                ssize_t n = read(fd, chunk, sizeof(chunk));
+                if (n <= 0) {return false;}
+                buffer.append(chunk, n);
+            }
+        }
+
+    private:
+        int fd;
+        string buffer;
+        size_t start = 0;
+};
+
+//write all of text to fd, false if the peer went away
+bool write_all(int fd, const string &text) {
+    size_t done = 0;
+    while (done < text.size()) {
+        ssize_t n = write(fd, text.data() + done, text.size() - done);
+        if (n <= 0) {return false;}
+        done += n;
+    }
+    return true;
+}
+
+/*
+    Reads the next job from a connection.
+
+    @return false at end of input
+*/
+bool read_job(LineReader &reader, Job &job) {
+    string line;
+    job = Job();
+    bool started = false;
+    while (reader.getLine(line)) {
+        if (line.empty()) {continue;}
+        if (!started) {
+            if (line.compare(0, 4, "JOB ") == 0 || line == "JOB") {
+                started = true;
+                job.name = line.size() > 4 ? line.substr(4) : "";
+            }
+            else if (job.error.empty()) {
+                job.error = "expected JOB, got: " + line;
+            }
+            continue;
+        }
+        if (line == "END") {return true;}
+        size_t addr;
+        unsigned instr;
+        if (parse_machine_code_line(line, addr, instr)) {
+            if (addr != job.image.size()) {
+                job.error = "Memory addresses encountered out of sequence: " + to_string(addr);
+            }
+            else if (addr >= MEM_SIZE) {
+                job.error = "Program too big for memory";
+            }
+            else {
+                job.image.push_back(instr);
+            }
+        }
+        else if (line.compare(0, 6, "CACHE ") == 0) {
+            job.cache_config = line.substr(6);
+        }
+        else if (line.compare(0, 9, "MAXSTEPS ") == 0) {
+            job.max_steps = strtoull(line.c_str() + 9, nullptr, 10);
+        }
+        else if (line.compare(0, 10, "TIMELIMIT ") == 0) {
+            job.time_limit = atof(line.c_str() + 10);
+        }
+        else if (job.error.empty()) {
+            job.error = "Can't parse line: " + line;
+        }
+    }
+    return false;
+}
+
+/*
+    The objects a worker thread keeps between jobs: one machine and the
+    caches of the last geometry it ran, which are cleared and reused when
+    the next job asks for the same geometry.
+*/
+class Worker {
+    public:
+        //run job, appending its output to out, returns the exit status the CLI would have
+        int run(const Job &job, ostringstream &out) {
+            auto start = chrono::steady_clock::now();
+            int status = 0;
+            machine.load(job.image);
+            Watchdog watchdog(job.max_steps, job.time_limit, false);
+            if (job.cache_config.empty()) {
+                machine.attach(nullptr);
+                status = run_watched(machine, watchdog);
+                print_state(machine.pc, machine.regs, machine.memory, 128, out);
+            }
+            else {
+                vector<int> parts;
+                if (!parseConfig(job.cache_config, parts)) {
+                    out << "Invalid cache config" << endl;
+                    status = 1;
+                }
+                else {
+                    L1 = reuse(move(L1), parts[0], parts[1], parts[2], "L1", out);
+                    if (parts.size() == 6) {L2 = reuse(move(L2), parts[3], parts[4], parts[5], "L2", out);}
+                    CacheHierarchy caches(L1.get(), parts.size() == 6 ? L2.get() : nullptr);
+                    machine.attach(&caches);
+                    status = run_watched(machine, watchdog);
+                    machine.attach(nullptr);
+                    //E20cachesim prints the state only for runs cut short; every job gets it back
+                    print_state(machine.pc, machine.regs, machine.memory, 128, out);
+                }
+            }
+            chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+            out << "STATS steps=" << machine.steps << " status=" << status <<
+                " micros=" << (long long)elapsed.count() << endl;
+            return status;
+        }
+
+    private:
+        E20Machine machine;
+        unique_ptr<Cache> L1;
+        unique_ptr<Cache> L2;
+
+        //split a --cache style config, which must have 3 or 6 positive parts
+        static bool parseConfig(const string &config, vector<int> &parts) {
+            stringstream ss(config);
+            string item;
+            while (getline(ss, item, ',')) {
+                int val = atoi(item.c_str());
+                if (val <= 0) {return false;}
+                parts.push_back(val);
+            }
+            if (parts.size() != 3 && parts.size() != 6) {return false;}
+            for (size_t i = 0; i < parts.size(); i += 3) {
+                if (parts[i] < parts[i+1]*parts[i+2]) {return false;}
+            }
+            return true;
+        }
+
+        //clear and return cache if it has the asked geometry, otherwise build a new one
+        static unique_ptr<Cache> reuse(unique_ptr<Cache> cache, int size, int assoc, int blocksize, const string &name, ostream &out) {
+            if (cache && cache->total_size == size && cache->assoc == assoc && cache->blocksize == blocksize) {
+                cache->clear(out);
+                return cache;
+            }
+            return unique_ptr<Cache>(new Cache(size, assoc, blocksize, name, out));
+        }
+};
+
+//a parsed job waiting for a worker, and its output once one has run it
+struct Task {
+    Job job;
+    ostringstream out;
+    bool done = false;
+    mutex m;
+    condition_variable cv;
+
+    //called by the worker once out holds the whole reply
+    void finish() {
+        lock_guard<mutex> lock(m);
+        done = true;
+        cv.notify_one();
+    }
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        cv.wait(lock, [&] {return done;});
+    }
+};
+
+//jobs of all connections waiting for a worker, oldest first
+class TaskQueue {
+    public:
+        void push(Task *task) {
+            lock_guard<mutex> lock(m);
+            tasks.push_back(task);
+            cv.notify_one();
+        }
+
+        Task* pop() {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] {return !tasks.empty();});
+            Task *task = tasks.front();
+            tasks.pop_front();
+            return task;
+        }
+
+    private:
+        mutex m;
+        condition_variable cv;
+        deque<Task*> tasks;
+};
+
+/*
+    Read every job of one connection until the client closes it, queueing
+    each for the workers and writing its reply before reading the next, so
+    replies come back in order. The connection holds a worker only while
+    one of its jobs runs, so idle clients never keep others waiting.
+*/
+void serve_connection(int fd, TaskQueue &queue) {
+    LineReader reader(fd);
+    while (true) {
+        Task task;
+        if (!read_job(reader, task.job)) {break;}
+        if (!task.job.error.empty()) {
+            task.out << "ERROR " << task.job.error << endl;
+        }
+        else {
+            queue.push(&task);
+            task.wait();
+        }
+        task.out << "DONE " << task.job.name << endl;
+        if (!write_all(fd, task.out.str())) {break;}
+    }
+    close(fd);
+}
+
+
+/**
+    Main function
+    Takes command-line args as documented below
+*/
+int main(int argc, char *argv[]) {
+    /*
+        Parse the command-line arguments
+    */
+    char *socket_path = nullptr;
+    bool do_help = false;
+    bool arg_error = false;
+    int num_threads = thread::hardware_concurrency();
+    for (int i=1; i<argc; i++) {
+        string arg(argv[i]);
+        if (arg== "-h" || arg == "--help")
+            do_help = true;
+        else if (arg=="--socket" || arg=="--threads") {
+            i++;
+            if (i>=argc)
+                arg_error = true;
+            else if (arg=="--socket")
+                socket_path = argv[i];
+            else if ((num_threads = atoi(argv[i])) <= 0)
+                arg_error = true;
+        }
+        else
+            arg_error = true;
+    }
+    /* Display error message if appropriate */
+    if (arg_error || do_help || socket_path == nullptr) {
+        cerr << "usage " << argv[0] << " [-h] --socket PATH [--threads N]" << endl << endl;
+        cerr << "Serve E20 simulation jobs over a Unix domain socket" << endl << endl;
+        cerr << "optional arguments:"<<endl;
+        cerr << "  -h, --help     show this help message and exit"<<endl;
+        cerr << "  --socket PATH  Socket to listen on, replaced if it exists"<<endl;
+        cerr << "  --threads N    Worker threads (default: one per host CPU)"<<endl;
+        return 1;
+    }
+    if (num_threads <= 0)
+        num_threads = 1;
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        cerr << "Socket path too long: " << socket_path << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listener < 0 || ::bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        cerr << "Can't listen on " << socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    //a client that hangs up early must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    //workers run the jobs, while each connection gets a thread of its own that only reads and writes it
+    TaskQueue queue;
+    vector<thread> workers;
+    for (int i = 0; i < num_threads; ++i) {
+        workers.emplace_back([&queue] {
+            Worker worker;
+            while (true) {
+                Task *task = queue.pop();
+                worker.run(task->job, task->out);
+                task->finish();
+            }
+        });
+    }
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0)
+            thread(serve_connection, fd, ref(queue)).detach();
+        else if (errno != EINTR)
+            break;
+    }
+    cerr << "accept failed: " << strerror(errno) << endl;
+    //the workers never return, and a joinable thread would terminate the process on exit.
+    //exit leaves the queue they wait on in place, where returning would destroy it under them
+    for (thread &worker : workers) {worker.detach();}
+    exit(1);
+}
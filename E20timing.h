@@ -0,0 +1,668 @@
+/*
+E20 timing library
+A discrete-event timing model of non-blocking caches with MSHRs, driven
+by an in-order core that only waits for a load when its value is used.
+E20timing.h
+*/
+
+#ifndef E20TIMING_H
+#define E20TIMING_H
+
+#include <cstdint>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+
+#include "E20machine.h"
+#include "E20cache.h"
+#include "E20dram.h"
+
+
+using namespace std;
+
+
+class EventHandler;
+
+//something that happens to target at time, kind and arg are the target's to interpret
+struct Event {
+    unsigned long long time;
+    //order of scheduling, so events due at the same time run first come first served
+    unsigned long long seq;
+    EventHandler *target;
+    int kind;
+    unsigned long long arg;
+};
+
+class EventHandler {
+    public:
+        virtual ~EventHandler() {}
+        virtual void handle(const Event &event) = 0;
+};
+
+/*
+    Time-ordered queue of pending events. Events are taken from a pool that
+    grows in chunks and are put back once handled, so a long run allocates
+    only as many as were ever pending at once.
+*/
+class EventQueue {
+    public:
+        //time of the event being handled, or of the last one
+        unsigned long long now = 0;
+        unsigned long long handled = 0;
+
+        void schedule(unsigned long long time, EventHandler *target, int kind, unsigned long long arg = 0) {
+            if (pool.empty()) {grow();}
+            Event *event = pool.back();
+            pool.pop_back();
+            *event = Event{max(time, now), seq++, target, kind, arg};
+            heap.push_back(event);
+            push_heap(heap.begin(), heap.end(), later);
+        }
+
+        bool empty() {return heap.empty();}
+
+        //time of the next event, ULLONG_MAX if there is none
+        unsigned long long next() {return heap.empty() ? ULLONG_MAX : heap.front()->time;}
+
+        //handle the next event, returns false if there was none
+        bool runNext() {
+            if (heap.empty()) {
+                return false;
+            }
+            pop_heap(heap.begin(), heap.end(), later);
+            Event *event = heap.back();
+            heap.pop_back();
+            now = event->time;
+            Event copy = *event;
+            pool.push_back(event);
+            handled++;
+            copy.target->handle(copy);
+            return true;
+        }
+
+        //handle every event due by time, then move the clock to time
+        void runUntil(unsigned long long time) {
+            while (!heap.empty() && heap.front()->time <= time) {runNext();}
+            now = max(now, time);
+        }
+
+    private:
+        vector<Event*> heap;
+        vector<Event*> pool;
+        vector<unique_ptr<Event[]>> chunks;
+        unsigned long long seq = 0;
+
+        static bool later(const Event *a, const Event *b) {
+            return a->time != b->time ? a->time > b->time : a->seq > b->seq;
+        }
+
+        void grow() {
+            size_t count = chunks.empty() ? 64 : 64 << min(chunks.size(), (size_t)10);
+            chunks.emplace_back(new Event[count]);
+            for (size_t i = 0; i < count; ++i) {pool.push_back(&chunks.back()[i]);}
+        }
+};
+
+//event kind a level posts to its requester once the requested block is there, arg is the requester's token
+int const static EVENT_DONE = 0;
+
+//a level of the timed hierarchy that accepts block requests
+class TimedLevel : public EventHandler {
+    public:
+        /*
+            Ask for the count cells from addr. Once they are available an
+            EVENT_DONE carrying token is posted to requester.
+
+            @return false if the level is out of MSHRs and the request must be retried later
+        */
+        virtual bool request(uint16_t addr, int count, EventHandler *requester, unsigned long long token) = 0;
+};
+
+//main memory, with a fixed latency or timed by a DRAM model
+class TimedMemory : public TimedLevel {
+    public:
+        TimedMemory(EventQueue &Queue, unsigned Latency, DramModel *Dram) : queue(Queue), latency(Latency), dram(Dram) {}
+
+        unsigned long long requests = 0;
+
+        bool request(uint16_t addr, int count, EventHandler *requester, unsigned long long token) override {
+            requests++;
+            unsigned cycles = dram ? dram->access(addr, count, false) : latency;
+            queue.schedule(queue.now + cycles, requester, EVENT_DONE, token);
+            return true;
+        }
+
+        void handle(const Event &/*event*/) override {}
+
+    private:
+        EventQueue &queue;
+        unsigned latency;
+        DramModel *dram;
+};
+
+/*
+    A non-blocking cache level over the tags of a Cache. A hit is answered
+    after the hit latency. A miss takes one of the level's MSHRs (miss status
+    holding registers) for its block until the block arrives from below;
+    further misses to a block already being fetched are merged into its MSHR
+    rather than sent again, and when every MSHR is busy new misses are
+    refused. Tags are filled when the block arrives, so a block in flight
+    is never a hit.
+
+    Occupancy of the MSHRs is integrated over time: the average while any
+    is busy is the memory-level parallelism the level saw.
+*/
+class TimedCache : public TimedLevel {
+    public:
+        TimedCache(EventQueue &Queue, Cache &Tags, unsigned HitLatency, int Mshrs, TimedLevel *Below, unsigned Mem[]) :
+            queue(Queue), tags(Tags), hit_latency(HitLatency), mshrs(Mshrs), below(Below), mem(Mem) {}
+
+        unsigned long long accesses = 0;
+        unsigned long long hits = 0;
+        //hits served while at least one miss was outstanding
+        unsigned long long hits_under_miss = 0;
+        unsigned long long misses = 0;
+        //misses merged into the MSHR of a block already in flight
+        unsigned long long merged = 0;
+        //requests refused because every MSHR was busy
+        unsigned long long refused = 0;
+
+        bool request(uint16_t addr, int /*count*/, EventHandler *requester, unsigned long long token) override {
+            int blockid = addr/tags.blocksize;
+            auto pending = outstanding.find(blockid);
+            if (pending != outstanding.end()) {
+                accesses++;
+                merged++;
+                pending->second.push_back(Waiter{requester, token});
+                return true;
+            }
+            int assoc = tags.find(addr);
+            if (assoc != -1) {
+                accesses++;
+                hits++;
+                if (!outstanding.empty()) {hits_under_miss++;}
+                tags.rows[tags.rowOf(addr)]->pushToTail(assoc);
+                queue.schedule(queue.now + hit_latency, requester, EVENT_DONE, token);
+                return true;
+            }
+            if ((int)outstanding.size() >= mshrs) {
+                refused++;
+                return false;
+            }
+            accesses++;
+            misses++;
+            integrate();
+            outstanding[blockid].push_back(Waiter{requester, token});
+            //the miss is known once the tags are checked
+            queue.schedule(queue.now + hit_latency, this, EVENT_FORWARD, blockid);
+            return true;
+        }
+
+        void handle(const Event &event) override {
+            int blockid = event.arg;
+            if (event.kind == EVENT_FORWARD) {
+                //keep asking until the level below has an MSHR free
+                if (!below->request(blockid*tags.blocksize, tags.blocksize, this, blockid)) {
+                    queue.schedule(queue.now + 1, this, EVENT_FORWARD, blockid);
+                }
+                return;
+            }
+            tags.fill(blockid*tags.blocksize, mem);
+            integrate();
+            vector<Waiter> waiters;
+            waiters.swap(outstanding[blockid]);
+            outstanding.erase(blockid);
+            for (const Waiter &waiter : waiters) {
+                queue.schedule(queue.now, waiter.requester, EVENT_DONE, waiter.token);
+            }
+        }
+
+        //print the counters and memory-level parallelism under the cache's name
+        void print(ostream &out) {
+            integrate();
+            out << tags.name << " timing: hit latency " << hit_latency << ", MSHRs " << mshrs << endl;
+            out << tags.name << " accesses " << accesses << ", hits " << hits << " (under miss " << hits_under_miss <<
+                "), misses " << misses << " (merged " << merged << "), refused " << refused << endl;
+            out << fixed << setprecision(2) << tags.name << " memory-level parallelism: " <<
+                (busy_cycles ? (double)mshr_cycles/busy_cycles : 0.0) << " over " << busy_cycles << " busy cycles" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+
+    private:
+        struct Waiter {
+            EventHandler *requester;
+            unsigned long long token;
+        };
+
+        int const static EVENT_FORWARD = 1;
+
+        EventQueue &queue;
+        Cache &tags;
+        unsigned hit_latency;
+        int mshrs;
+        TimedLevel *below;
+        unsigned *mem;
+        //MSHRs by block id, each with the requests waiting on the block
+        unordered_map<int, vector<Waiter>> outstanding;
+        unsigned long long last_change = 0;
+        unsigned long long busy_cycles = 0;
+        unsigned long long mshr_cycles = 0;
+
+        //account the time since the MSHR count last changed
+        void integrate() {
+            unsigned long long elapsed = queue.now - last_change;
+            if (!outstanding.empty()) {busy_cycles += elapsed;}
+            mshr_cycles += elapsed*outstanding.size();
+            last_change = queue.now;
+        }
+};
+
+/*
+    Decodes the registers an instruction reads and writes, -1 for none.
+    Register 0 is returned like any other; it is never waited on.
+*/
+inline void decode_registers(uint16_t instruction, int &src1, int &src2, int &dst)
+{
+    uint16_t op = (instruction & 0b1110000000000000) >> 13;
+    int regA = (instruction & 0b0001110000000000) >> 10;
+    int regB = (instruction & 0b0000001110000000) >> 7;
+    int regC = (instruction & 0b0000000001110000) >> 4;
+    src1 = src2 = dst = -1;
+    if (op == 0) {
+        src1 = regA;
+        if ((instruction & 0b1111) != 8) {
+            src2 = regB;
+            dst = regC;
+        }
+    }
+    else if (op == 1 || op == 7 || op == 4) {
+        src1 = regA;
+        dst = regB;
+    }
+    else if (op == 5 || op == 6) {
+        src1 = regA;
+        src2 = regB;
+    }
+    else if (op == 3) {
+        dst = 7;
+    }
+}
+
+/*
+    In-order core that issues one instruction per cycle over a functional
+    E20 machine. Each instruction executes at once; the timing only decides
+    when it could have issued. A lw sends its request and moves on, so
+    independent instructions and further misses overlap with it, and only
+    an instruction reading the loaded register waits for the data. A sw
+    is posted and never waited for. A request the L1 refuses stalls issue
+    until an MSHR frees.
+*/
+class TimingCore : public EventHandler {
+    public:
+        TimingCore(E20Machine &Machine, EventQueue &Queue, TimedLevel &L1) : machine(Machine), queue(Queue), L1(L1) {
+            fill(ready, ready + NUM_REGS, 0);
+            fill(loads, loads + NUM_REGS, 0);
+        }
+
+        unsigned long long cycle = 0;
+        //cycles issue waited for loaded registers, and for an MSHR
+        unsigned long long load_stalls = 0;
+        unsigned long long mshr_stalls = 0;
+        unsigned long long loads_issued = 0;
+        unsigned long long stores_issued = 0;
+
+        /*
+            Runs the machine until it halts or the watchdog stops it, then
+            waits for the outstanding accesses.
+
+            @return 0, or the watchdog exit status if the run was cut short
+        */
+        int run(Watchdog &watchdog) {
+            int status = 0;
+            while (!machine.halted && status == 0) {
+                issue();
+                if (!machine.halted && machine.steps >= watchdog.next_check) {
+                    status = watchdog.check(machine.steps);
+                }
+            }
+            while (queue.runNext()) {}
+            cycle = max(cycle, queue.now);
+            if (status != 0) {
+                cerr << "Stopped at pc " << machine.pc << " after " << machine.steps << " instructions: " << watchdog.reason << endl;
+            }
+            return status;
+        }
+
+        void handle(const Event &event) override {
+            //a later write to the register may have replaced the load's value
+            int reg = event.arg % NUM_REGS;
+            if (loads[reg] == event.arg) {
+                ready[reg] = queue.now;
+                loads[reg] = 0;
+            }
+        }
+
+        //print cycles, IPC and where issue stalled
+        void print(ostream &out) {
+            out << "Cycles " << cycle << ", instructions " << machine.steps << fixed << setprecision(2) <<
+                ", IPC " << (cycle ? (double)machine.steps/cycle : 0.0) << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+            out << "Loads " << loads_issued << ", stores " << stores_issued << ", load-use stall cycles " << load_stalls <<
+                ", MSHR stall cycles " << mshr_stalls << endl;
+        }
+
+    private:
+        E20Machine &machine;
+        EventQueue &queue;
+        TimedLevel &L1;
+        //cycle each register's value is available, valid while no load is outstanding on it
+        unsigned long long ready[NUM_REGS];
+        //token of the load outstanding on each register, 0 if none
+        unsigned long long loads[NUM_REGS];
+        unsigned long long next_token = 1;
+
+        //issue the instruction at pc once its operands are ready, then execute it
+        void issue() {
+            //registers read and written, -1 for none
+            int src1, src2, dst;
+            decode_registers(machine.memory[machine.pc], src1, src2, dst);
+
+            unsigned long long start = cycle;
+            while (pending(src1) || pending(src2)) {queue.runNext();}
+            cycle = max(cycle, max(operand(src1), operand(src2)));
+            load_stalls += cycle - start;
+            queue.runUntil(cycle);
+
+            uint16_t addr, reg;
+            bool store;
+            if (machine.nextAccess(addr, store, reg)) {
+                unsigned long long token = 0;
+                if (!store && reg != 0) {
+                    //tokens carry the register in their low bits
+                    token = next_token++*NUM_REGS + reg;
+                }
+                start = cycle;
+                while (!L1.request(addr, 1, this, token)) {
+                    //nothing frees an MSHR before the next event
+                    queue.runNext();
+                    cycle = max(cycle, queue.now);
+                }
+                mshr_stalls += cycle - start;
+                if (store) {stores_issued++;}
+                else {loads_issued++;}
+                if (token != 0) {
+                    loads[reg] = token;
+                    dst = -1;
+                }
+            }
+            if (dst > 0) {
+                ready[dst] = cycle + 1;
+                loads[dst] = 0;
+            }
+            machine.step();
+            cycle++;
+        }
+
+        bool pending(int reg) {return reg > 0 && loads[reg] != 0;}
+
+        unsigned long long operand(int reg) {return reg > 0 ? ready[reg] : 0;}
+};
+
+/*
+    Out-of-order core over a functional E20 machine, in the execute-at-fetch
+    style: each instruction executes when it is fetched, so its operands,
+    address and the path taken are known, and the timing only decides when
+    it could have issued and retired. Every cycle up to width instructions
+    retire in order from the head of the reorder buffer, up to width whose
+    operands are ready issue, oldest first, and up to width are fetched
+    into it. Registers are renamed to the entry that writes them, so only
+    true dependences order instructions. The fetched path is the executed
+    one, so branches are predicted perfectly. ALU instructions take a cycle.
+
+    Loads and stores also hold an entry of the load/store queue until they
+    retire. A load issues once every older store has its address. It takes
+    its value from the youngest older store to the same address if there is
+    one, and otherwise asks the L1, while younger instructions go on. Stores
+    write the L1 when they retire. An access the L1 refuses for lack of an
+    MSHR is retried the next cycle.
+
+    Cycles in which nothing retires are charged to what the oldest
+    instruction waits for, and cycles with fetch cut short to the full
+    reorder buffer or load/store queue.
+*/
+class OooCore : public EventHandler {
+    public:
+        OooCore(E20Machine &Machine, EventQueue &Queue, TimedLevel &L1, int RobSize, int Width, int LsqSize) :
+            machine(Machine), queue(Queue), L1(L1), rob_size(RobSize), width(Width), lsq_size(LsqSize) {
+            fill(producer, producer + NUM_REGS, 0);
+        }
+
+        unsigned long long cycle = 0;
+        unsigned long long loads_issued = 0;
+        unsigned long long forwarded = 0;
+        unsigned long long stores_retired = 0;
+        //cycles nothing retired because the oldest instruction waited for a load's data from
+        //the caches, for an MSHR, for its operands or execution, or because none was fetched
+        unsigned long long memory_stalls = 0;
+        unsigned long long mshr_stalls = 0;
+        unsigned long long execute_stalls = 0;
+        unsigned long long empty_stalls = 0;
+        //cycles fetch stopped early on a full reorder buffer or load/store queue
+        unsigned long long rob_full = 0;
+        unsigned long long lsq_full = 0;
+        //reorder buffer entries in use, summed over cycles
+        unsigned long long rob_occupancy = 0;
+
+        /*
+            Runs the machine until it halts or the watchdog stops it, then
+            retires what was fetched and waits for the outstanding accesses.
+
+            @return 0, or the watchdog exit status if the run was cut short
+        */
+        int run(Watchdog &watchdog) {
+            int status = 0;
+            while ((!machine.halted && status == 0) || !rob.empty()) {
+                queue.runUntil(cycle);
+                int retired = retire();
+                int issued = issue();
+                int fetched = status == 0 ? fetch(watchdog, status) : 0;
+                //with nothing done, nothing changes before the next access completes or instruction finishes
+                unsigned long long cycles = 1;
+                if (retired == 0 && issued == 0 && fetched == 0) {
+                    unsigned long long next = queue.next();
+                    for (const Entry &entry : rob) {
+                        if (entry.issued && entry.done > cycle) {next = min(next, entry.done);}
+                    }
+                    if (next != ULLONG_MAX) {cycles = next - cycle;}
+                }
+                if (retired == 0) {chargeStall(cycles);}
+                if (fetch_block == FETCH_ROB_FULL) {rob_full += cycles;}
+                if (fetch_block == FETCH_LSQ_FULL) {lsq_full += cycles;}
+                rob_occupancy += rob.size()*cycles;
+                cycle += cycles;
+            }
+            while (queue.runNext()) {}
+            cycle = max(cycle, queue.now);
+            if (status != 0) {
+                cerr << "Stopped at pc " << machine.pc << " after " << machine.steps << " instructions: " << watchdog.reason << endl;
+            }
+            return status;
+        }
+
+        void handle(const Event &event) override {
+            //loads carry their sequence number + 1, stores 0
+            if (event.arg == 0) {
+                return;
+            }
+            unsigned long long seq = event.arg - 1;
+            if (seq >= head_seq && seq < head_seq + rob.size()) {rob[seq - head_seq].done = queue.now;}
+        }
+
+        //print cycles, IPC and where retirement and fetch stalled
+        void print(ostream &out) {
+            out << "Out-of-order core: reorder buffer " << rob_size << ", issue width " << width <<
+                ", load/store queue " << lsq_size << endl;
+            out << "Cycles " << cycle << ", instructions " << machine.steps << fixed << setprecision(2) <<
+                ", IPC " << (cycle ? (double)machine.steps/cycle : 0.0) << ", average reorder buffer occupancy " <<
+                (cycle ? (double)rob_occupancy/cycle : 0.0) << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+            out << "Loads " << loads_issued << " (forwarded from stores " << forwarded << "), stores " << stores_retired << endl;
+            out << "Retire stall cycles: memory " << memory_stalls << ", MSHR " << mshr_stalls << ", execute " <<
+                execute_stalls << ", empty " << empty_stalls << endl;
+            out << "Fetch stall cycles: reorder buffer full " << rob_full << ", load/store queue full " << lsq_full << endl;
+        }
+
+    private:
+        struct Entry {
+            //sequence number + 1 of the entries producing the operands, 0 for values already retired
+            unsigned long long src[2];
+            bool mem;
+            bool store;
+            uint16_t addr;
+            bool issued;
+            //the access was refused for lack of an MSHR
+            bool refused;
+            //cycle the result is available, ULLONG_MAX while a load waits for its data
+            unsigned long long done;
+        };
+
+        int const static FETCH_ROB_FULL = 1;
+        int const static FETCH_LSQ_FULL = 2;
+
+        E20Machine &machine;
+        EventQueue &queue;
+        TimedLevel &L1;
+        int rob_size;
+        int width;
+        int lsq_size;
+        deque<Entry> rob;
+        //sequence number of the entry at the head of the reorder buffer
+        unsigned long long head_seq = 0;
+        //rename table: sequence number + 1 of the youngest entry in flight writing each register, 0 if none
+        unsigned long long producer[NUM_REGS];
+        int lsq_used = 0;
+        //why fetch stopped short in the last cycle, 0 if it did not
+        int fetch_block = 0;
+
+        bool ready(unsigned long long src) {
+            return src == 0 || src - 1 < head_seq || rob[src - 1 - head_seq].done <= cycle;
+        }
+
+        int retire() {
+            int retired = 0;
+            while (!rob.empty() && retired < width) {
+                Entry &entry = rob.front();
+                if (!entry.issued || entry.done > cycle) {
+                    break;
+                }
+                if (entry.store) {
+                    entry.refused = !L1.request(entry.addr, 1, this, 0);
+                    if (entry.refused) {
+                        break;
+                    }
+                    stores_retired++;
+                }
+                if (entry.mem) {lsq_used--;}
+                for (unsigned long long &writer : producer) {
+                    if (writer == head_seq + 1) {writer = 0;}
+                }
+                rob.pop_front();
+                head_seq++;
+                retired++;
+            }
+            return retired;
+        }
+
+        int issue() {
+            int issued = 0;
+            //a load may not pass a store whose address is not known yet
+            bool store_unknown = false;
+            for (size_t i = 0; i < rob.size() && issued < width; ++i) {
+                Entry &entry = rob[i];
+                if (entry.issued) {
+                    continue;
+                }
+                if (!ready(entry.src[0]) || !ready(entry.src[1]) || (entry.mem && !entry.store && store_unknown)) {
+                    store_unknown = store_unknown || entry.store;
+                    continue;
+                }
+                if (entry.mem && !entry.store) {
+                    size_t from = i;
+                    while (from > 0 && !(rob[from - 1].store && rob[from - 1].addr == entry.addr)) {from--;}
+                    if (from > 0) {
+                        forwarded++;
+                        entry.done = cycle + 1;
+                    }
+                    else {
+                        entry.refused = !L1.request(entry.addr, 1, this, head_seq + i + 1);
+                        if (entry.refused) {
+                            continue;
+                        }
+                        entry.done = ULLONG_MAX;
+                    }
+                    loads_issued++;
+                }
+                else {
+                    entry.done = cycle + 1;
+                }
+                entry.issued = true;
+                issued++;
+            }
+            return issued;
+        }
+
+        //execute and queue up to width instructions, checking the watchdog after each
+        int fetch(Watchdog &watchdog, int &status) {
+            fetch_block = 0;
+            int fetched = 0;
+            while (fetched < width && !machine.halted && status == 0) {
+                if ((int)rob.size() >= rob_size) {
+                    fetch_block = FETCH_ROB_FULL;
+                    break;
+                }
+                Entry entry = Entry{{0, 0}, false, false, 0, false, false, ULLONG_MAX};
+                uint16_t reg;
+                entry.mem = machine.nextAccess(entry.addr, entry.store, reg);
+                if (entry.mem && lsq_used >= lsq_size) {
+                    fetch_block = FETCH_LSQ_FULL;
+                    break;
+                }
+                int src1, src2, dst;
+                decode_registers(machine.memory[machine.pc], src1, src2, dst);
+                entry.src[0] = src1 > 0 ? producer[src1] : 0;
+                entry.src[1] = src2 > 0 ? producer[src2] : 0;
+                machine.step();
+                rob.push_back(entry);
+                if (entry.mem) {lsq_used++;}
+                if (dst > 0) {producer[dst] = head_seq + rob.size();}
+                fetched++;
+                if (!machine.halted && machine.steps >= watchdog.next_check) {
+                    status = watchdog.check(machine.steps);
+                }
+            }
+            return fetched;
+        }
+
+        //charge cycles in which nothing retired to what the oldest instruction waits for
+        void chargeStall(unsigned long long cycles) {
+            if (rob.empty()) {
+                empty_stalls += cycles;
+                return;
+            }
+            const Entry &head = rob.front();
+            if (head.refused) {mshr_stalls += cycles;}
+            else if (head.mem && !head.store && head.issued && head.done == ULLONG_MAX) {memory_stalls += cycles;}
+            else {execute_stalls += cycles;}
+        }
+};
+
+#endif
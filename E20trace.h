@@ -0,0 +1,284 @@
+/*
+E20 trace library
+Reads memory address traces of other machines and runs them through the
+cache model, so the caches can be studied on workloads that are not E20
+programs.
+E20trace.h
+*/
+
+#ifndef E20TRACE_H
+#define E20TRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <iomanip>
+
+#include "E20cache.h"
+
+
+using namespace std;
+
+
+//largest access a trace record may make, in the trace's units; x86's widest vector
+//stores are 64 bytes, so anything past a page is a corrupt line
+uint64_t const static MAX_TRACE_ACCESS = 4096;
+
+//trace formats understood by TraceReader
+enum TraceFormat {TRACE_AUTO, TRACE_DIN, TRACE_LACKEY};
+
+//one record of a trace. Kind is 'L' load, 'S' store, 'M' modify (a load then a
+//store), 'I' instruction fetch, or 'X' for records that access no data
+struct TraceRecord {
+    char kind;
+    uint64_t addr;
+    unsigned size;
+};
+
+/*
+    Streams records out of a text trace in one of two formats:
+        din     Dinero III: "label address [size]", label 0 read, 1 write,
+                2 instruction fetch, 3 and 4 other; address in hex
+        lackey  Valgrind lackey: "I  addr,size" for fetches and
+                " L addr,size", " S addr,size", " M addr,size" for data,
+                address in hex
+    The input is read in large chunks and each record is parsed in place in
+    the chunk, with no per-line string; a line cut by the end of a chunk is
+    moved to the front before the next read. Lines that fit neither format,
+    like lackey's "==pid==" banners, are skipped and counted, as are records
+    whose number overflows, whose size is past MAX_TRACE_ACCESS, or whose
+    access runs past the end of the address space.
+*/
+class TraceReader {
+    public:
+        TraceReader(istream &In, TraceFormat Format, size_t ChunkSize = 1 << 20) :
+            in(In), format(Format), buffer(ChunkSize) {}
+
+        unsigned long long lines = 0;
+        unsigned long long malformed = 0;
+
+        //parse the next record, false at the end of the trace
+        bool next(TraceRecord &record) {
+            while (true) {
+                char *end = pos == limit ? nullptr : static_cast<char*>(memchr(pos, '\n', limit - pos));
+                if (end == nullptr) {
+                    if (!refill()) {
+                        return false;
+                    }
+                    continue;
+                }
+                char *line = pos;
+                pos = end + 1;
+                lines++;
+                if (parse(line, end, record)) {
+                    return true;
+                }
+            }
+        }
+
+    private:
+        istream &in;
+        TraceFormat format;
+        vector<char> buffer;
+        char *pos = nullptr;
+        char *limit = nullptr;
+        bool eof = false;
+
+        //keep the unparsed tail, read after it, and end a last line without a newline
+        bool refill() {
+            if (eof) {
+                if (pos != nullptr && pos < limit) {
+                    //the last line had no newline
+                    *limit = '\n';
+                    limit++;
+                    return true;
+                }
+                return false;
+            }
+            size_t tail = pos == nullptr ? 0 : limit - pos;
+            if (tail > 0) {memmove(buffer.data(), pos, tail);}
+            //a line longer than the buffer grows it, leaving room for the closing newline
+            if (tail + 1 >= buffer.size()) {buffer.resize(buffer.size()*2);}
+            in.read(buffer.data() + tail, buffer.size() - tail - 1);
+            size_t got = in.gcount();
+            eof = got == 0 || !in;
+            pos = buffer.data();
+            limit = pos + tail + got;
+            return got > 0 || tail > 0;
+        }
+
+        static bool isSpace(char c) {return c == ' ' || c == '\t' || c == '\r';}
+
+        static const char* skipSpace(const char *p, const char *end) {
+            while (p < end && isSpace(*p)) {p++;}
+            return p;
+        }
+
+        //parse a hex number, returns nullptr if there is none or it does not fit in 64 bits
+        static const char* parseHex(const char *p, const char *end, uint64_t &val) {
+            if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {p += 2;}
+            const char *start = p;
+            val = 0;
+            for (; p < end; ++p) {
+                int digit;
+                if (*p >= '0' && *p <= '9') {digit = *p - '0';}
+                else if (*p >= 'a' && *p <= 'f') {digit = *p - 'a' + 10;}
+                else if (*p >= 'A' && *p <= 'F') {digit = *p - 'A' + 10;}
+                else {break;}
+                if (val >> 60 != 0) {
+                    return nullptr;
+                }
+                val = (val << 4) | digit;
+            }
+            return p == start ? nullptr : p;
+        }
+
+        static const char* parseDec(const char *p, const char *end, uint64_t &val) {
+            const char *start = p;
+            val = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+                if (val > (UINT64_MAX - 9)/10) {
+                    return nullptr;
+                }
+                val = val*10 + (*p - '0');
+            }
+            return p == start ? nullptr : p;
+        }
+
+        //set the record's size, false if it is too large or the access wraps around the address space
+        static bool setSize(TraceRecord &record, uint64_t size) {
+            if (size == 0) {size = 1;}
+            if (size > MAX_TRACE_ACCESS || record.addr > UINT64_MAX - (size - 1)) {
+                return false;
+            }
+            record.size = size;
+            return true;
+        }
+
+        bool parse(const char *p, const char *end, TraceRecord &record) {
+            p = skipSpace(p, end);
+            if (p == end) {
+                return false;
+            }
+            TraceFormat line_format = format;
+            if (line_format == TRACE_AUTO) {
+                line_format = (*p >= '0' && *p <= '9') ? TRACE_DIN : TRACE_LACKEY;
+            }
+            bool ok = line_format == TRACE_DIN ? parseDin(p, end, record) : parseLackey(p, end, record);
+            if (!ok) {malformed++;}
+            return ok;
+        }
+
+        bool parseDin(const char *p, const char *end, TraceRecord &record) {
+            uint64_t label, size = 1;
+            if ((p = parseDec(p, end, label)) == nullptr || label > 4) {
+                return false;
+            }
+            if ((p = parseHex(skipSpace(p, end), end, record.addr)) == nullptr) {
+                return false;
+            }
+            p = skipSpace(p, end);
+            if (p < end && parseDec(p, end, size) == nullptr) {
+                return false;
+            }
+            static const char kinds[] = {'L', 'S', 'I', 'X', 'X'};
+            record.kind = kinds[label];
+            return setSize(record, size);
+        }
+
+        bool parseLackey(const char *p, const char *end, TraceRecord &record) {
+            char kind = *p;
+            if (kind != 'I' && kind != 'L' && kind != 'S' && kind != 'M') {
+                return false;
+            }
+            uint64_t size;
+            if ((p = parseHex(skipSpace(p + 1, end), end, record.addr)) == nullptr || p == end || *p != ',') {
+                return false;
+            }
+            if (parseDec(p + 1, end, size) == nullptr) {
+                return false;
+            }
+            record.kind = kind;
+            return setSize(record, size);
+        }
+};
+
+/*
+    Runs trace records through one or two tag-only caches, in the same
+    non-inclusive arrangement as CacheHierarchy: a load that misses L1
+    looks in L2 and fills both, and a store writes through, filling both
+    levels on a miss. An access that spans several blocks touches each of
+    them. Addresses and cache sizes are in the trace's units, usually bytes.
+*/
+class TraceHierarchy {
+    public:
+        TraceHierarchy(Cache* l1, Cache* l2) : L1(l1), L2(l2) {}
+
+        Cache* L1;
+        Cache* L2;
+        unsigned long long loads = 0;
+        unsigned long long stores = 0;
+        unsigned long long modifies = 0;
+        unsigned long long fetches = 0;
+        unsigned long long others = 0;
+        //block accesses, hits and misses by level, L1 then L2
+        unsigned long long accesses[2] = {0, 0};
+        unsigned long long hits[2] = {0, 0};
+
+        void access(const TraceRecord &record) {
+            switch (record.kind) {
+                case 'L': loads++; break;
+                case 'S': stores++; break;
+                case 'M': modifies++; break;
+                case 'I': fetches++; return;
+                default: others++; return;
+            }
+            uint64_t first = record.addr/L1->blocksize;
+            uint64_t last = (record.addr + record.size - 1)/L1->blocksize;
+            for (uint64_t block = first; block <= last; ++block) {
+                uint64_t addr = max(record.addr, block*L1->blocksize);
+                if (record.kind == 'M') {
+                    //the load brings the block in, so the store that follows always hits
+                    touch(addr, false);
+                    touch(addr, true);
+                }
+                else {
+                    touch(addr, record.kind == 'S');
+                }
+            }
+        }
+
+        //print the record counts and each level's hits and misses
+        void print(ostream &out, const TraceReader &reader) {
+            out << "Trace records " << reader.lines << ": loads " << loads << ", stores " << stores <<
+                ", modifies " << modifies << ", instruction fetches " << fetches << ", other " << others <<
+                ", skipped lines " << reader.malformed << endl;
+            printLevel(out, *L1, 0);
+            if (L2 != nullptr) {printLevel(out, *L2, 1);}
+        }
+
+    private:
+        void touch(uint64_t addr, bool store) {
+            accesses[0]++;
+            bool hit = L1->accessTag(addr);
+            if (hit) {hits[0]++;}
+            //loads only reach L2 on an L1 miss, stores write through to it
+            if (L2 != nullptr && (store || !hit)) {
+                accesses[1]++;
+                if (L2->accessTag(addr)) {hits[1]++;}
+            }
+        }
+
+        void printLevel(ostream &out, Cache &cache, int level) {
+            unsigned long long misses = accesses[level] - hits[level];
+            out << cache.name << " accesses " << accesses[level] << ", hits " << hits[level] << ", misses " << misses <<
+                fixed << setprecision(2) << " (miss rate " << (accesses[level] ? 100.0*misses/accesses[level] : 0.0) <<
+                "%)" << endl;
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+};
+
+#endif